@@ -0,0 +1,121 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Builds and serializes the vision packets of a full field, 16 robots per team seen by four cameras, as fast as
+// VisionSender::process() allows. The packets go to no server, so only generating and serializing is measured.
+//
+//   vision_bench [frames]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "visionsender.h"
+#include "logger.h"
+
+#define BENCH_CAMERAS 4
+#define BENCH_OVERLAP 0.3
+
+// Defined by the world and the status widget in grSim, neither of which the benchmark links
+dReal normalizeAngle(dReal a)
+{
+    if (a > 180) return -360 + a;
+    if (a < -180) return 360 + a;
+    return a;
+}
+
+void logStatus(QString s, QColor c)
+{
+    Q_UNUSED(c);
+    fprintf(stderr, "%s\n", s.toLocal8Bit().constData());
+}
+
+// The quadrant cameras of the point, and its neighbours when it lies in the overlap
+static uint32_t camerasContaining(dReal x, dReal y)
+{
+    int cx = x < 0 ? 0 : 1, cy = y < 0 ? 0 : 2;
+    uint32_t cameras = 1u << (cx + cy);
+    if (fabs(x) < BENCH_OVERLAP) cameras |= 1u << ((1 - cx) + cy);
+    if (fabs(y) < BENCH_OVERLAP) cameras |= 1u << (cx + (2 - cy));
+    if (fabs(x) < BENCH_OVERLAP && fabs(y) < BENCH_OVERLAP) cameras |= 1u << ((1 - cx) + (2 - cy));
+    return cameras;
+}
+
+static void place(VisionFrame& frame, int n)
+{
+    WorldSnapshot& s = frame.snapshot;
+    double t = n/60.0;
+    s.ballX = 4*sin(t);
+    s.ballY = 3*cos(0.7*t);
+    s.ballZ = 0;
+    frame.ballCameras = camerasContaining(s.ballX, s.ballY);
+    for (int i=0;i<frame.robotCount*2;i++)
+    {
+        s.robotX[i] = 5.5*sin(0.3*t + i);
+        s.robotY[i] = 4*cos(0.2*t + 2*i);
+        s.robotDir[i] = fmod(10*t + 20*i, 360) - 180;
+        s.robotOn[i] = true;
+        frame.robotCameras[i] = camerasContaining(s.robotX[i], s.robotY[i]);
+    }
+    frame.t_capture = t;
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 100000;
+    if (frames <= 0) frames = 100000;
+
+    VisionFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.robotCount = MAX_ROBOT_COUNT;
+    frame.cameras = (1u << BENCH_CAMERAS) - 1;
+    frame.jitterModel = JITTER_GAUSSIAN;
+    frame.noiseSeed = 1;
+    frame.noise = true;
+    frame.deviationX = 3;
+    frame.deviationY = 3;
+    frame.deviationAngle = 2;
+    frame.payloadBudget = 1400;
+
+    VisionSender sender;
+    // warm up, the messages and the delay line buffers grow to their final size
+    for (int n=0;n<100;n++)
+    {
+        place(frame, n);
+        sender.process(frame);
+        sender.sendDue(frame.t_capture + 1);
+    }
+    sender.report();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int n=0;n<frames;n++)
+    {
+        place(frame, n);
+        sender.process(frame);
+        // releases the packets to no server, which empties the delay line
+        sender.sendDue(frame.t_capture + 1);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%d frames of %d robots and %d cameras in %.3f s\n", frames, frame.robotCount*2, BENCH_CAMERAS, elapsed);
+    printf("%.0f frames/s, %.2f us per frame\n", frames/elapsed, elapsed/frames*1e6);
+    printf("%s\n", sender.report().toLocal8Bit().constData());
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CAMERALAYOUT_H
+#define CAMERALAYOUT_H
+
+#include <QString>
+#include <stdint.h>
+
+#define MAX_CAMERA_COUNT 16
+#define CAMERA_GRID_SIZE 32
+
+// Part of the field seen by one camera
+struct CameraRegion {
+    double minX, maxX, minY, maxY;
+};
+
+// Mounting point of a camera above the field, meters
+struct CameraPosition {
+    double x, y, z;
+};
+
+// Field coverage of the vision cameras. The regions are either tiled over the field with an overlap or loaded
+// from a layout file, and a lookup grid over the field gives the cameras that see a point without testing
+// every region.
+class CameraLayout
+{
+public:
+    CameraLayout();
+    void fromField(int count, double fieldLength, double fieldWidth, double margin, double overlap, double height);
+    bool loadFromIniFile(const QString &filename, double defaultHeight);
+    int camerasContaining(double x, double y, int* ids) const;
+    int count() const { return cameraCount; }
+    const CameraRegion& region(int i) const { return regions[i]; }
+    const CameraPosition& position(int i) const { return positions[i]; }
+    // capture rate (Hz) and phase (s) of a camera, the given defaults apply unless the layout file sets them
+    double captureRate(int i, double defaultRate) const { return rates[i] >= 0 ? rates[i] : defaultRate; }
+    double capturePhase(int i, double defaultPhase) const { return phases[i] >= 0 ? phases[i] : defaultPhase; }
+    // latency and its jitter (ms) from capture to sending
+    double sendLatency(int i, double defaultLatency) const { return latencies[i] >= 0 ? latencies[i] : defaultLatency; }
+    double sendJitter(int i, double defaultJitter) const { return jitters[i] >= 0 ? jitters[i] : defaultJitter; }
+private:
+    void buildGrid();
+    CameraRegion regions[MAX_CAMERA_COUNT];
+    CameraPosition positions[MAX_CAMERA_COUNT];
+    double rates[MAX_CAMERA_COUNT], phases[MAX_CAMERA_COUNT];
+    double latencies[MAX_CAMERA_COUNT], jitters[MAX_CAMERA_COUNT];
+    int cameraCount;
+    // per grid cell the cameras covering all of it and the cameras covering part of it
+    uint32_t fullMask[CAMERA_GRID_SIZE][CAMERA_GRID_SIZE];
+    uint32_t partialMask[CAMERA_GRID_SIZE][CAMERA_GRID_SIZE];
+    double gridMinX, gridMinY, cellSizeX, cellSizeY;
+};
+
+#endif // CAMERALAYOUT_H
@@ -116,6 +116,22 @@ public:
     double WheelTangentFriction;
     double WheelPerpendicularFriction;
     double Wheel_Motor_FMax;
+    //motor settings
+    enum { IdealMotor = 0, DCMotor };
+    int MotorModel;
+    double MotorVoltage;
+    double MotorResistance;
+    double MotorTorqueConstant;
+    double MotorGearRatio;
+    double MotorCurrentLimit;
+    double MotorSpeedGain;
+    double BatteryResistance;
+    //kicker charge settings
+    double KickerChargeTime;
+    double KickerCapacitorEnergy;
+    double KickerEfficiency;
+    double KickerFlatDischargeTime;
+    double KickerChipDischargeTime;
 };
 
 
@@ -132,9 +148,11 @@ public:
   virtual ~ConfigWidget();
 
   QSettings* robot_settings;
-  RobotSettings robotSettings;
   RobotSettings blueSettings;
   RobotSettings yellowSettings;
+  QMap<int, QString> blueModels, yellowModels;   // robots of a team that use another robot config
+  QMap<QString, RobotSettings> robotModels;
+  const RobotSettings& getRobotSettings(int team, int id);
 
   /*    Geometry/Game Vartypes   */
 
@@ -166,23 +184,51 @@ public:
   DEF_VALUE(double,Double,BallBounceVel)
   DEF_VALUE(double,Double,BallLinearDamp)
   DEF_VALUE(double,Double,BallAngularDamp)
+  DEF_ENUM(std::string,DribbleMode)
+  DEF_VALUE(double,Double,DribbleReleaseForce)
 
   DEF_VALUE(bool,Bool,SyncWithGL)
+  DEF_VALUE(bool,Bool,ClockAnchoredToWall)
   DEF_VALUE(double,Double,DesiredFPS)
   DEF_VALUE(double,Double,DeltaTime)
+  DEF_VALUE(double,Double,ControllerRate)
+  DEF_VALUE(double,Double,CommandTimeout)
+  DEF_VALUE(double,Double,CommandRampRate)
   DEF_VALUE(int,Int,sendGeometryEvery)
+  DEF_VALUE(int,Int,VisionPayloadBudget)
+  DEF_VALUE(std::string,String,VisionSubscribersFile)
+  DEF_ENUM(std::string,VisionTransport)
+  DEF_VALUE(std::string,String,VisionSocketPath)
+  DEF_ENUM(std::string,CommandTransport)
+  DEF_VALUE(std::string,String,CommandSocketPath)
+  DEF_VALUE(bool,Bool,GroundTruth)
+  DEF_VALUE(std::string,String,GroundTruthAddr)
+  DEF_VALUE(int,Int,GroundTruthPort)
+  DEF_VALUE(double,Double,GroundTruthRate)
   DEF_VALUE(double,Double,Gravity)
+  DEF_VALUE(bool,Bool,MotorTrace)
   DEF_VALUE(std::string,String,VisionMulticastAddr)
   DEF_VALUE(int,Int,VisionMulticastPort)
   DEF_VALUE(int,Int,CommandListenPort)
   DEF_VALUE(int,Int,BlueStatusSendPort)
   DEF_VALUE(int,Int,YellowStatusSendPort)
+  DEF_VALUE(bool,Bool,ExtendedStatus)
   DEF_VALUE(int,Int,sendDelay)
+  DEF_VALUE(double,Double,sendJitter)
+  DEF_ENUM(std::string,sendJitterModel)
+  DEF_VALUE(bool,Bool,VisionThread)
   DEF_VALUE(int,Int,nCameras)
+  DEF_VALUE(double,Double,CameraOverlap)
+  DEF_VALUE(std::string,String,CameraLayoutFile)
+  DEF_VALUE(double,Double,CameraHeight)
+  DEF_VALUE(bool,Bool,Occlusion)
+  DEF_VALUE(double,Double,CameraRate)
+  DEF_VALUE(double,Double,CameraPhaseStep)
   DEF_VALUE(bool,Bool,noise)
   DEF_VALUE(double,Double,noiseDeviation_x)
   DEF_VALUE(double,Double,noiseDeviation_y)
   DEF_VALUE(double,Double,noiseDeviation_angle)
+  DEF_VALUE(int,Int,noiseSeed)
   DEF_VALUE(bool,Bool,vanishing)
   DEF_VALUE(double,Double,ball_vanishing)
   DEF_VALUE(double,Double,blue_team_vanishing)
@@ -190,7 +236,7 @@ public:
   DEF_VALUE(std::string, String, plotter_addr)
   DEF_VALUE(int, Int, plotter_port)
   DEF_VALUE(bool, Bool, plotter)
-  void loadRobotSettings(QString team);
+  RobotSettings loadRobotSettings(QString team, QMap<int, QString> &models);
 public slots:
   void loadRobotsSettings();
 };
@@ -0,0 +1,65 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DELAYLINE_H
+#define DELAYLINE_H
+
+#include <string>
+#include <stdint.h>
+#include <google/protobuf/message_lite.h>
+
+#define DELAY_LINE_CAPACITY 1024
+#define DELAY_LINE_BATCH 64
+// the vision server and up to 8 subscribers
+#define DELAY_LINE_DESTINATIONS 9
+
+class RoboCupSSLServer;
+class QUdpSocket;
+
+// How late the sent datagrams left after their release times, in seconds
+struct SendLateness {
+    double sum, max;
+    int count;
+};
+
+// Datagrams waiting for their release time, serialized once when they are queued and sent to every destination
+// at its own release time. The slots form a ring in queueing order and keep their buffers, so once they have
+// grown to the packet size queueing and sending allocate nothing. Datagrams with different latencies may be
+// released out of order, the ring then advances past the released slots once the oldest one is sent everywhere.
+class DelayLine
+{
+public:
+    DelayLine();
+    int push(const google::protobuf::MessageLite& packet, const double* release, uint32_t destinations);
+    int send(double now, RoboCupSSLServer* const* servers, int count, SendLateness* lateness = 0, QUdpSocket* socket = 0);
+    double nextRelease() const;
+    void clear();
+    int pending() const { return queued; }
+private:
+    struct Slot {
+        std::string data;
+        double release[DELAY_LINE_DESTINATIONS];
+        // destinations the datagram is still waiting for
+        uint32_t waiting;
+    };
+    Slot ring[DELAY_LINE_CAPACITY];
+    int tail, span, queued;
+};
+
+#endif // DELAYLINE_H
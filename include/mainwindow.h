@@ -48,6 +48,7 @@ public slots:
     void changeBallDamping();
     void changeGravity();
     void changeTimer();
+    void dumpMotorTrace();
 
     void restartSimulator();
     void ballMenuTriggered(QAction* act);
@@ -62,7 +63,10 @@ public slots:
     void reconnectYellowStatusSocket();
     void reconnectBlueStatusSocket();
     void reconnectVisionSocket();
+    void reconnectGroundTruthSocket();
+    void reconnectVisionSubscribers();
     void recvActions();
+    void recvLocalActions();
     void setIsGlEnabled(bool value);
 
     int robotIndex(int robot,int team);
@@ -80,14 +84,18 @@ private:
 
     QAction *showsimulator, *showconfig;
     QAction* fullScreenAct;
-    QLabel *physicsspslabel, *physicsaveragesteptimelabel, *fpslabel,*cursorlabel,*selectinglabel,*vanishlabel,*noiselabel;
+    QLabel *physicsspslabel, *physicsaveragesteptimelabel, *fpslabel,*cursorlabel,*selectinglabel,*vanishlabel,*noiselabel,*visionsendlabel;
     QString current_dir;
 
     QGraphicsScene *scene;
     GLWidgetGraphicsView *view;
     QSize lastSize;
     RoboCupSSLServer *visionServer;
+    RoboCupSSLServer *groundTruthServer;
+    VisionSubscriber visionSubscribers[VISION_MAX_SUBSCRIBERS];
+    int visionSubscriberCount;
     QUdpSocket *commandSocket;
+    LocalDatagramSocket *localCommandSocket;
     QUdpSocket *blueStatusSocket,*yellowStatusSocket;
 };
 
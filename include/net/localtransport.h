@@ -0,0 +1,115 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LOCALTRANSPORT_H
+#define LOCALTRANSPORT_H
+
+#include <QObject>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <stdint.h>
+
+class QSocketNotifier;
+
+// Same-host transports for clients running next to the simulator, available on Linux only.
+// The payloads are the same protobuf messages as on UDP.
+
+// Layout of the shared memory ring, for clients. Datagram n is written to slot n % slots: the writer
+// stores seq = 2n+1, copies the data, stores seq = 2n+2 and then written = n+1. A reader expecting n
+// waits while written <= n, skips to written - slots when it fell behind by more than the ring, and
+// drops the slot when seq is not 2n+2 both before and after copying it.
+// Clients connect to the doorbell socket and receive the shared memory name as the payload and an
+// eventfd (SCM_RIGHTS) that is signalled after every batch of datagrams.
+#define SHM_RING_MAGIC 0x67725368
+#define SHM_RING_SLOTS 64
+#define SHM_RING_SLOT_SIZE 65536
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    uint32_t reserved;
+    std::atomic<uint64_t> written;
+};
+
+// followed by slotSize bytes of data
+struct ShmRingSlot
+{
+    std::atomic<uint64_t> seq;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+// Unix SOCK_DGRAM socket. It only needs a path of its own to receive, senders can stay unbound.
+class LocalDatagramSocket : public QObject
+{
+    Q_OBJECT
+public:
+    LocalDatagramSocket(QObject* parent=0);
+    ~LocalDatagramSocket();
+    bool bind(const QString& path);
+    bool hasPendingDatagrams();
+    int readDatagram(char* data, int maxSize, QString* sender=0);
+    // Never blocks; returns the number of datagrams handed to the kernel, -1 on errors other than
+    // a missing or congested receiver
+    int writeDatagrams(const char* const* data, const int* sizes, int count, const QString& path);
+    bool writeDatagram(const char* data, int size, const QString& path) { return writeDatagrams(&data, &size, 1, path) == 1; }
+signals:
+    void readyRead();
+private:
+    bool create();
+    int fd;
+    QString boundPath;
+    QSocketNotifier* notifier;
+};
+
+// Single-writer ring of datagrams in POSIX shared memory, named after the file name of the doorbell path
+class SharedMemoryRing : public QObject
+{
+    Q_OBJECT
+public:
+    SharedMemoryRing(QObject* parent=0);
+    ~SharedMemoryRing();
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return header != NULL; }
+    bool write(const char* data, int size);
+    void ringDoorbell();
+    int subscribers();
+private slots:
+    void acceptSubscriber();
+private:
+    struct Subscriber
+    {
+        int connection;
+        int doorbell;
+    };
+    QMutex mutex;
+    QString doorPath, shmName;
+    int listenFd;
+    QSocketNotifier* notifier;
+    ShmRingHeader* header;
+    size_t mapSize;
+    uint64_t next;
+    QVector<Subscriber> subs;
+};
+
+#endif // LOCALTRANSPORT_H
@@ -22,6 +22,7 @@
 #ifndef ROBOCUP_SSL_SERVER_H
 #define ROBOCUP_SSL_SERVER_H
 #include <string>
+#include <atomic>
 #include <QMutex>
 #include <QObject>
 #include "messages_robocup_ssl_detection.pb.h"
@@ -32,11 +33,19 @@ using namespace std;
 class QUdpSocket;
 class QHostAddress;
 class QNetworkInterface;
+class LocalDatagramSocket;
+class SharedMemoryRing;
 
 class RoboCupSSLServer
 {
 friend class MultiStackRoboCupSSL;
 public:
+    enum Transport {
+        UDP,
+        UNIX_SOCKET,
+        SHARED_MEMORY
+    };
+
     RoboCupSSLServer(QObject *parent=0,
                      const quint16 &port=10002,
                      const string &net_address="224.5.23.2",
@@ -45,11 +54,16 @@ public:
     ~RoboCupSSLServer();
 
     bool send(const SSL_WrapperPacket & packet);
+    bool send(const char * data, int size, QUdpSocket * socket = 0);
+    bool send(const char * const * data, const int * sizes, int count, QUdpSocket * socket = 0);
     bool send(const SSL_DetectionFrame & frame);
     bool send(const SSL_GeometryData & geometry);
     void change_port(const quint16 &port);
     void change_address(const string & net_address);
     void change_interface(const string & net_interface);
+    bool change_transport(Transport transport, const string & path);
+    quint64 datagramsSent() const { return _datagrams; }
+    quint64 sendCalls() const { return _send_calls; }
 
 protected:
     QUdpSocket * _socket;
@@ -57,6 +71,14 @@ protected:
     quint16 _port;
     QHostAddress * _net_address;
     QNetworkInterface * _net_interface;
+    // read by the GUI while the vision thread sends
+    std::atomic<quint64> _datagrams;
+    std::atomic<quint64> _send_calls;
+    Transport _transport;
+    QObject * _parent;
+    QString _path;
+    LocalDatagramSocket * _local;
+    SharedMemoryRing * _ring;
 };
 
 #endif
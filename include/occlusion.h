@@ -0,0 +1,48 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#define OCCLUSION_MAX_OBSTACLES 64
+#define OCCLUSION_BUCKETS 64
+#define OCCLUSION_CELL_SIZE 0.25
+
+// Vertical cylinders standing on the field, the robots of one capture, hashed by the grid cell of their center.
+// A line of sight only needs testing against the cylinders near its low end: it rises above the tallest
+// cylinder within a short distance of the object unless the camera is close to the horizon.
+class OcclusionGrid
+{
+public:
+    OcclusionGrid();
+    void clear();
+    void add(double x, double y, double radius, double height);
+    bool occluded(double x, double y, double z, double camX, double camY, double camZ) const;
+private:
+    static int bucket(int cx, int cy);
+    struct Obstacle {
+        double x, y, radius, height;
+        int next;
+    };
+    Obstacle obstacles[OCCLUSION_MAX_OBSTACLES];
+    int head[OCCLUSION_BUCKETS];
+    int count;
+    double maxRadius, maxHeight;
+};
+
+#endif // OCCLUSION_H
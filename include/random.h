@@ -0,0 +1,51 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// xoshiro256+ generator of Blackman and Vigna, seeded through splitmix64. Every world owns its generator, so
+// the noise of a world is reproducible under a seed and worlds share no lock.
+class Random
+{
+public:
+    Random(uint64_t seed = 1);
+    void seed(uint64_t seed);
+    uint64_t next()
+    {
+        const uint64_t result = s[0] + s[3];
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = (s[3] << 45) | (s[3] >> 19);
+        return result;
+    }
+    // uniform in [0, 1)
+    double uniform() { return (next() >> 11) * (1.0/9007199254740992.0); }
+    void gaussian(double* out, int n);
+private:
+    uint64_t s[4];
+};
+
+#endif // RANDOM_H
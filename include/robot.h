@@ -25,6 +25,64 @@ Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
 #include "physics/pball.h"
 #include "configwidget.h"
 
+#include <array>
+
+// Robots per team
+#define MAX_ROBOT_COUNT 16
+
+// Number of robots handled per pass of Robot::stepMotors and Robot::updateBallContacts
+#define COMMAND_BATCH_SIZE 32
+
+// Size of the motor model trace ring buffer of each robot
+#define MOTOR_TRACE_SIZE 64
+#define TRAJECTORY_MAX_POINTS 64
+
+typedef std::array<double,4> WheelValues;
+
+// Ring buffer of motor model internals, filled only when "Trace motor model" is enabled
+class MotorTrace
+{
+public:
+    enum Event { TWO_WHEEL_ROTATION = 0, PWM_OUTPUT, WHEEL_SPEED };
+    struct Entry {
+        int event;
+        WheelValues values;
+    };
+    MotorTrace();
+    void record(int event, const WheelValues &values);
+    int count() const;
+    const Entry &at(int i) const; //0 is the oldest entry
+    void clear();
+private:
+    Entry entries[MOTOR_TRACE_SIZE];
+    int head, size;
+};
+
+struct TrajectoryPoint
+{
+    dReal t;
+    dReal x, y, w;      // field frame pose
+    dReal vx, vy, vw;   // field frame velocity
+};
+
+// Latest movement command received for a robot, decoded from grSim_Robot_Command. It is held as the
+// setpoint of the emulated on-board controller until the next command arrives.
+class RobotCommand
+{
+public:
+    enum Mode { NONE = 0, WHEELS, VELOCITY, ANGLE, PWM, PWM_ANGLE, TRAJECTORY };
+    RobotCommand();
+    void sampleTrajectory(dReal t, dReal* pose, dReal* vel) const;
+    bool trajectoryFinished() const;
+    int mode;
+    dReal vx, vy, vw;   // robot frame velocities (forces in PWM modes), vw is the target angle in *ANGLE modes
+    dReal wheel[4];     // wheel speeds in WHEELS mode
+    dReal age;          // simulated seconds since the command was received
+    bool stale;         // timed out, the wheels are being ramped to zero
+    TrajectoryPoint trajectory[TRAJECTORY_MAX_POINTS];
+    int trajectoryPoints;
+    dReal trajectoryTime;   // seconds since the trajectory start
+};
 
 class Robot
 {
@@ -37,10 +95,14 @@ class Robot
     bool firsttime;
     bool last_state;
     dReal prevYaw;
+    int lastMode;   // mode of the previous command, the angle modes start their derivatives from rest
     int TH_switch;
     double prevAngleErr;
+    dReal batteryCurrent;
+    dReal wheelSin[4], wheelCos[4];
 public:    
     ConfigWidget* cfg;
+    const RobotSettings* settings;  // resolved when the world is built, immutable afterwards
     dSpaceID space;
     PCylinder* chassis;
     PBall* dummy;
@@ -51,6 +113,7 @@ public:
     bool selected;
     dReal select_x,select_y,select_z;    
     QImage *img,*number;
+    MotorTrace motorTrace;
     class Wheel
     {
       public:
@@ -70,6 +133,26 @@ public:
         bool kicking;
         int rolling;
         int kickstate;
+        bool touchingBall;  // cached by Robot::updateBallContacts
+
+        // capacitor charge model, only used with a positive KickerChargeTime
+        enum ChargeState { CHARGING = 0, READY, DISCHARGING };
+        int chargeState;
+        dReal energy;
+        dReal dischargeTimer;
+        dReal pendingSpeedX, pendingSpeedZ;
+        void release(dReal kickspeedx, dReal kickspeedz);
+
+        // ball attachment of the "Soft joint" and "Kinematic" dribble modes, see Robot::stepDribblers
+        enum DribbleMode { ROLLER_TORQUE = 0, SOFT_JOINT, KINEMATIC };
+        bool holding;
+        bool holdBlocked;   // pulled off, not grabbed again before the ball left the kicker
+        int holdMode;
+        dJointID holdJoint;
+        dJointFeedback holdFeedback;
+        dVector3 holdOffset;
+        void grab(int mode);
+        bool hold(int mode, dReal dt);
 
 	// Angle of the kicker with respect to the robot in radians
 	// 0 radians makes the kicker shoot straight
@@ -81,7 +164,10 @@ public:
 	void rotate(dReal angle);
 	void rotateAbsolute(dReal angle);
         void step();
+        void stepCharge(dReal dt);
         void kick(dReal kickspeedx, dReal kickspeedz);
+        bool isReady();
+        void drop();
         void setRoller(int roller);
         int getRoller();
         void toggleRoller();
@@ -89,9 +175,10 @@ public:
         dJointID joint;
         PBox* box;
         Robot* rob;
+        friend class Robot;
     } *kicker;
     Robot() = default;
-    Robot(PWorld* world,PBall* ball,ConfigWidget* _cfg,dReal x,dReal y,dReal z,dReal r,dReal g,dReal b,int rob_id,int wheeltexid,int dir);
+    Robot(PWorld* world,PBall* ball,ConfigWidget* _cfg,const RobotSettings* _settings,dReal x,dReal y,dReal z,dReal r,dReal g,dReal b,int rob_id,int wheeltexid,int dir);
     ~Robot();
     void step();
     void drawLabel();
@@ -109,15 +196,21 @@ public:
     PBall* getBall();
 
     void setAngle(dReal vx, dReal vy, dReal vw);
-    std::vector<double> body2Wheels(dReal Fx, dReal Fy, dReal Fw);
+    static void applyCommands(Robot** robots, const RobotCommand* commands, int count, dReal dt);
+    void applyCommand(const RobotCommand &command, dReal dt);
+    static void stepMotors(Robot** robots, int count);
+    static void updateBallContacts(Robot** robots, int count);
+    static void stepDribblers(Robot** robots, int count, dReal dt);
+    void setPWM(dReal Fx, dReal Fy, dReal Fw);
+    WheelValues body2Wheels(dReal Fx, dReal Fy, dReal Fw, bool* twoWheels = NULL);
     dReal scaleLimit(dReal Fx, dReal Fy, dReal Fw, dReal limit);
-    double angleControl(double angleRef, double yaw);
-    std::vector<double> pwm2Motor(std::vector<double> power);
-    double constrainAngle(double x);
+    double angleControl(double angleRef, double yaw, double dt = 1/60.0);
+    WheelValues pwm2Motor(WheelValues power);
+    static double constrainAngle(double x);
     void vectorRotate(double yaw, double* x, double* y);
 };
 
 
-#define ROBOT_START_Z(cfg)  (cfg->robotSettings.RobotHeight*0.5 + cfg->robotSettings.WheelRadius*1.1 + cfg->robotSettings.BottomHeight)
+#define ROBOT_START_Z(settings)  (settings->RobotHeight*0.5 + settings->WheelRadius*1.1 + settings->BottomHeight)
 
 #endif // ROBOT_H
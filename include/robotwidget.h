@@ -35,7 +35,7 @@ public:
     void setPicture(QImage* img);
     QComboBox *teamCombo,*robotCombo;
     QLabel *robotpic;
-    QLabel *vellabel,*acclabel;
+    QLabel *vellabel,*acclabel,*cmdagelabel;
     QPushButton *resetBtn,*locateBtn;
     QPushButton *onOffBtn,*setPoseBtn;
     GetPositionWidget* getPoseWidget;
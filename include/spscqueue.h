@@ -0,0 +1,52 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+
+// Lock-free queue between one producer and one consumer thread over a fixed ring of N items, N a power of
+// two. The producer fills back() in place and publishes it with push(), the consumer reads front() and hands
+// the item back with pop(). back() and front() return 0 when the queue is full or empty.
+template <typename T, unsigned N>
+class SpscQueue
+{
+public:
+    SpscQueue() : head(0), tail(0) {}
+    T* back()
+    {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return 0;
+        return &items[t % N];
+    }
+    void push() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    T* front()
+    {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return 0;
+        return &items[h % N];
+    }
+    void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+private:
+    T items[N];
+    std::atomic<unsigned> head, tail;
+};
+
+#endif // SPSCQUEUE_H
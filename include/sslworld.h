@@ -32,37 +32,28 @@ Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
 #include "physics/pray.h"
 
 #include "net/robocup_ssl_server.h"
+#include "net/localtransport.h"
+#include "grSim_GroundTruth.pb.h"
 
 #include "robot.h"
 #include "configwidget.h"
+#include "cameralayout.h"
+#include "visionsender.h"
+#include "occlusion.h"
 
 #define WALL_COUNT 10
-#define MAX_ROBOT_COUNT 16
 
 class RobotsFormation;
-class SendingPacket {
-    public:
-        SendingPacket(SSL_WrapperPacket* _packet, int _t);
-        SSL_WrapperPacket* packet;
-        int t;
-};
+class grSim_Packet;
 
 class SSLWorld : public QObject {
     Q_OBJECT
     private:
-
-        enum AmountOfCameras {
-          EIGHT = 8,
-          FOUR = 4,
-          TWO = 2,
-          ONE = 1
-        };
-        AmountOfCameras getAmountOfCameras();
-
         QGLWidget* m_parent;
         int framenum;
         dReal last_dt;
-        QList<SendingPacket*> sendQueue;
+        dReal controlTime;
+        dReal simTime, timeOrigin;
         char packet[200];
         char* in_buffer;
     public:
@@ -72,7 +63,14 @@ class SSLWorld : public QObject {
         virtual ~SSLWorld();
         void glinit();
         void step(dReal dt = - 1);
-        SSL_WrapperPacket* generatePacket(int cam_id = 0);
+        dReal worldClock() const { return timeOrigin + simTime; }
+        void stepController(dReal dt);
+        void takeSnapshot(WorldSnapshot& snapshot);
+        void interpolateSnapshot(const WorldSnapshot& a, const WorldSnapshot& b, dReal f, WorldSnapshot& out);
+        void captureFrame(const WorldSnapshot& snapshot, uint32_t cameras, dReal t_capture);
+        void captureCameras(dReal dt);
+        void resetCameraSchedule();
+        void buildGeometry();
         void addFieldLinesArcs(SSL_GeometryFieldSize* field);
         Vector2f* allocVector(float x, float y);
         void addFieldLine(SSL_GeometryFieldSize* field, const std::string &name, float p1_x, float p1_y, float p2_x,
@@ -80,8 +78,11 @@ class SSLWorld : public QObject {
         void addFieldArc(SSL_GeometryFieldSize* field, const string &name, float c_x, float c_y, float radius, float a1,
                 float a2, float thickness);
         void sendVisionBuffer();
+        void sendGroundTruth();
+        void processPacket(const grSim_Packet& packet, const QHostAddress& sender, const QString& senderPath);
         int  robotIndex(int robot,int team);
-        bool visibleInCam(int id, double x, double y);
+        void updateCameraLayout();
+        void releaseBall();
 
         ConfigWidget* cfg;
         CGraphics* g;
@@ -95,13 +96,32 @@ class SSLWorld : public QObject {
         dReal cursor_x, cursor_y, cursor_z;
         dReal cursor_radius;
         RoboCupSSLServer* visionServer;
+        VisionSender* visionSender;
+        RoboCupSSLServer* groundTruthServer;
         QUdpSocket* commandSocket;
+        LocalDatagramSocket* localCommandSocket;
         QUdpSocket* blueStatusSocket, * yellowStatusSocket;
         bool updatedCursor;
         Robot* robots[MAX_ROBOT_COUNT*2];
+        RobotSettings robotSettings[MAX_ROBOT_COUNT*2];
+        RobotCommand commands[MAX_ROBOT_COUNT*2];
         int sendGeomCount;
+        std::string geometryDatagram;
+        grSim_GroundTruth groundTruth;
+        std::string groundTruthDatagram;
+        dReal nextGroundTruth;
+        CameraLayout cameraLayout;
+        int layoutCameras;
+        double layoutOverlap, layoutHeight;
+        OcclusionGrid occlusion;
+        QString layoutFile;
+        // camera capture schedule on simulated time, used when CameraRate is set
+        WorldSnapshot lastSnapshot;
+        dReal nextCapture[MAX_CAMERA_COUNT];
+        double scheduleRate, schedulePhaseStep;
     public slots:
         void recvActions();
+        void recvLocalActions();
     signals:
         void fpsChanged(int newFPS);
 };
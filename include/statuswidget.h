@@ -28,6 +28,7 @@ Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
 #include <QTime>
 #include <QQueue>
 #include <QColor>
+#include <QMutex>
 
 
 class CStatusText
@@ -51,6 +52,8 @@ class CStatusPrinter
     CStatusPrinter() {}
 
     QQueue<CStatusText> textBuffer;
+    // the vision sender thread logs too
+    QMutex mutex;
 };
 
 
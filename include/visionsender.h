@@ -0,0 +1,134 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef VISIONSENDER_H
+#define VISIONSENDER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <stdint.h>
+
+#include "robot.h"
+#include "configwidget.h"
+#include "cameralayout.h"
+#include "delayline.h"
+#include "spscqueue.h"
+#include "random.h"
+#include "net/robocup_ssl_server.h"
+
+#define VISION_QUEUE_SIZE 64
+#define VISION_MAX_SUBSCRIBERS (DELAY_LINE_DESTINATIONS - 1)
+// noise values of one frame: x and y of the ball, and x, y and direction of every robot, per camera
+#define VISION_NOISE_SIZE ((2 + 3*MAX_ROBOT_COUNT*2)*MAX_CAMERA_COUNT)
+
+// Poses the vision packets are built from, positions in meters and directions in degrees
+struct WorldSnapshot {
+    dReal ballX, ballY, ballZ;
+    dReal robotX[MAX_ROBOT_COUNT*2], robotY[MAX_ROBOT_COUNT*2], robotDir[MAX_ROBOT_COUNT*2];
+    bool robotOn[MAX_ROBOT_COUNT*2];
+};
+
+enum JitterModel {
+    JITTER_GAUSSIAN,
+    JITTER_UNIFORM,
+    JITTER_EXPONENTIAL
+};
+
+// One capture of a set of cameras: the poses at the capture time, the cameras that see each object, the
+// latencies of the cameras and the noise and packet settings at the capture, everything needed to build and send
+// the packets without the world or the configuration, which the GUI thread may be editing
+struct VisionFrame {
+    WorldSnapshot snapshot;
+    int robotCount;
+    uint32_t cameras;
+    uint32_t ballCameras;
+    uint32_t robotCameras[MAX_ROBOT_COUNT*2];
+    dReal t_capture;
+    dReal latency[MAX_CAMERA_COUNT], jitter[MAX_CAMERA_COUNT];
+    JitterModel jitterModel;
+    int noiseSeed;
+    bool noise, vanishing;
+    dReal deviationX, deviationY, deviationAngle;
+    dReal ballVanishing, blueVanishing, yellowVanishing;
+    int payloadBudget;
+};
+
+// Datagrams and bytes of the vision frames since the previous report
+struct PacketStats {
+    int frames, datagrams, splitPackets, largest;
+    double bytes;
+};
+
+// Another receiver of the vision stream. Its packets leave after its own delay and jitter instead of the latencies
+// of the cameras (milliseconds), are lost with probability loss and only every decimation-th frame of a camera is
+// sent to it.
+struct VisionSubscriber {
+    RoboCupSSLServer* server;
+    double delay, jitter, loss;
+    int decimation;
+};
+
+// Builds, serializes and sends the vision packets of captured frames. Inline the world calls process() and
+// sendDue() itself. As a thread, the world publishes its frames into a lock-free queue and the thread sends
+// every packet at its release time on the world clock, which it follows between the world's updates with the
+// steady clock. The thread sends UDP through a socket of its own, the sockets of the servers belong to the GUI
+// thread.
+class VisionSender : public QThread
+{
+public:
+    VisionSender();
+    bool publish(const VisionFrame& frame);
+    void process(const VisionFrame& frame);
+    void sendDue(dReal now, QUdpSocket* socket = 0);
+    void setClock(dReal now);
+    void setSubscribers(const VisionSubscriber* subscribers, int count);
+    int subscriberCount() const { return nSubscribers; }
+    RoboCupSSLServer* subscriberServer(int i) const { return subscribers[i].server; }
+    QString report();
+    RoboCupSSLServer* server;
+protected:
+    void run();
+private:
+    dReal sendJitter(dReal jitter, JitterModel model);
+    dReal releaseTime(int d, int c, dReal t_capture, dReal latency, dReal jitter, JitterModel model);
+    int pushDetection(int c, const double* release, uint32_t destinations, int budget, PacketStats& stats);
+    dReal clock() const;
+    SpscQueue<VisionFrame, VISION_QUEUE_SIZE> queue;
+    SSL_WrapperPacket packets[MAX_CAMERA_COUNT];
+    SSL_WrapperPacket split;
+    int cameraFrames[MAX_CAMERA_COUNT];
+    VisionSubscriber subscribers[VISION_MAX_SUBSCRIBERS];
+    int nSubscribers;
+    // per destination, the vision server first
+    dReal lastRelease[DELAY_LINE_DESTINATIONS][MAX_CAMERA_COUNT];
+    DelayLine delayLine;
+    Random random;
+    int seededWith;
+    double noise[VISION_NOISE_SIZE];
+    // world clock minus steady clock, microseconds
+    std::atomic<int64_t> clockOffset;
+    std::atomic<int> droppedFrames;
+    QMutex statsMutex;
+    SendLateness lateness;
+    PacketStats packetStats;
+};
+
+#endif // VISIONSENDER_H
@@ -0,0 +1,203 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cameralayout.h"
+
+#include <QSettings>
+#include <QFile>
+#include <cmath>
+
+CameraLayout::CameraLayout()
+{
+    cameraCount = 0;
+    gridMinX = gridMinY = 0;
+    cellSizeX = cellSizeY = 1;
+    for (int i = 0; i < MAX_CAMERA_COUNT; i++) rates[i] = phases[i] = latencies[i] = jitters[i] = -1;
+}
+
+// Tiles count cameras over the field in the grid of rows and columns whose cells are closest to the 4:3 image of a
+// camera mounted with its long side along y, as in the usual SSL setups. Camera ids go row by row from the positive y
+// side, neighbouring regions overlap by overlap meters and the outer regions are unbounded so that objects off the
+// field are still seen. The cameras hang at the given height above the centers of their cells.
+void CameraLayout::fromField(int count, double fieldLength, double fieldWidth, double margin, double overlap, double height)
+{
+    if (count < 1) count = 1;
+    if (count > MAX_CAMERA_COUNT) count = MAX_CAMERA_COUNT;
+    const double inf = 1e6;
+    double length = fieldLength + 2*margin, width = fieldWidth + 2*margin;
+    int rows = 1;
+    double best = inf;
+    for (int r = 1; r <= count; r++)
+    {
+        if (count % r != 0) continue;
+        double aspect = (length/(count/r))/(width/r);
+        double error = fabs(log(aspect*4.0/3.0));
+        if (error < best - 1e-9)
+        {
+            best = error;
+            rows = r;
+        }
+    }
+    int cols = count/rows;
+    double cellLength = fieldLength/cols, cellWidth = fieldWidth/rows;
+    for (int i = 0; i < count; i++)
+    {
+        int c = i % cols, r = i / cols;
+        CameraRegion &region = regions[i];
+        region.minX = (c == 0) ? -inf : -fieldLength/2 + c*cellLength - overlap/2;
+        region.maxX = (c == cols - 1) ? inf : -fieldLength/2 + (c + 1)*cellLength + overlap/2;
+        region.maxY = (r == 0) ? inf : fieldWidth/2 - r*cellWidth + overlap/2;
+        region.minY = (r == rows - 1) ? -inf : fieldWidth/2 - (r + 1)*cellWidth - overlap/2;
+        positions[i].x = -fieldLength/2 + (c + 0.5)*cellLength;
+        positions[i].y = fieldWidth/2 - (r + 0.5)*cellWidth;
+        positions[i].z = height;
+        rates[i] = phases[i] = latencies[i] = jitters[i] = -1;
+    }
+    cameraCount = count;
+    gridMinX = - length/2;
+    gridMinY = - width/2;
+    cellSizeX = length/CAMERA_GRID_SIZE;
+    cellSizeY = width/CAMERA_GRID_SIZE;
+    buildGrid();
+}
+
+/*
+ * Load cameras from an ini file, each given by its region or by its position above the field:
+
+[Camera 0]
+MinX = -6.5
+MaxX = 0.5
+MinY = -5
+MaxY = 5
+[Camera 1]
+X = 3
+Y = 0
+Height = 4
+FieldOfView = 90
+Rate = 60
+Phase = 0.008
+Latency = 12
+Jitter = 2
+
+ * FieldOfView is the opening angle in degrees along the long side of the 4:3 image, which lies along y.
+ * Rate (Hz) and Phase (s, time of the first capture) are optional and override the Communication settings,
+ * as do Latency and Jitter (ms) of the packets of the camera. Cameras given by a region may set their mounting
+ * point with X, Y and Height, by default they hang over the middle of the region at the CameraHeight setting.
+ */
+bool CameraLayout::loadFromIniFile(const QString &filename, double defaultHeight)
+{
+    if (!QFile::exists(filename)) return false;
+    QSettings settings(filename, QSettings::IniFormat);
+    int count = 0;
+    double minX = 0, maxX = 0, minY = 0, maxY = 0;
+    for (int i = 0; i < MAX_CAMERA_COUNT; i++)
+    {
+        QString group = QString("Camera %1/").arg(i);
+        CameraRegion &region = regions[count];
+        if (settings.contains(group + "MinX"))
+        {
+            region.minX = settings.value(group + "MinX").toDouble();
+            region.maxX = settings.value(group + "MaxX").toDouble();
+            region.minY = settings.value(group + "MinY").toDouble();
+            region.maxY = settings.value(group + "MaxY").toDouble();
+            positions[count].x = settings.value(group + "X", (region.minX + region.maxX)/2).toDouble();
+            positions[count].y = settings.value(group + "Y", (region.minY + region.maxY)/2).toDouble();
+            positions[count].z = settings.value(group + "Height", defaultHeight).toDouble();
+        }
+        else if (settings.contains(group + "Height"))
+        {
+            double x = settings.value(group + "X").toDouble();
+            double y = settings.value(group + "Y").toDouble();
+            double h = settings.value(group + "Height").toDouble();
+            double halfY = h*tan(settings.value(group + "FieldOfView", 90).toDouble()*M_PI/360.0);
+            double halfX = halfY*3.0/4.0;
+            region.minX = x - halfX;
+            region.maxX = x + halfX;
+            region.minY = y - halfY;
+            region.maxY = y + halfY;
+            positions[count].x = x;
+            positions[count].y = y;
+            positions[count].z = h;
+        }
+        else break;
+        rates[count] = settings.value(group + "Rate", -1).toDouble();
+        phases[count] = settings.value(group + "Phase", -1).toDouble();
+        latencies[count] = settings.value(group + "Latency", -1).toDouble();
+        jitters[count] = settings.value(group + "Jitter", -1).toDouble();
+        if (count == 0 || region.minX < minX) minX = region.minX;
+        if (count == 0 || region.maxX > maxX) maxX = region.maxX;
+        if (count == 0 || region.minY < minY) minY = region.minY;
+        if (count == 0 || region.maxY > maxY) maxY = region.maxY;
+        count++;
+    }
+    if (count == 0) return false;
+    cameraCount = count;
+    gridMinX = minX;
+    gridMinY = minY;
+    cellSizeX = (maxX - minX)/CAMERA_GRID_SIZE;
+    cellSizeY = (maxY - minY)/CAMERA_GRID_SIZE;
+    if (cellSizeX <= 0) cellSizeX = 1;
+    if (cellSizeY <= 0) cellSizeY = 1;
+    buildGrid();
+    return true;
+}
+
+void CameraLayout::buildGrid()
+{
+    for (int gx = 0; gx < CAMERA_GRID_SIZE; gx++)
+        for (int gy = 0; gy < CAMERA_GRID_SIZE; gy++)
+        {
+            double x0 = gridMinX + gx*cellSizeX, x1 = x0 + cellSizeX;
+            double y0 = gridMinY + gy*cellSizeY, y1 = y0 + cellSizeY;
+            fullMask[gx][gy] = partialMask[gx][gy] = 0;
+            for (int i = 0; i < cameraCount; i++)
+            {
+                const CameraRegion &r = regions[i];
+                if (r.maxX <= x0 || r.minX >= x1 || r.maxY <= y0 || r.minY >= y1) continue;
+                if (r.minX < x0 && r.maxX > x1 && r.minY < y0 && r.maxY > y1) fullMask[gx][gy] |= 1u << i;
+                else partialMask[gx][gy] |= 1u << i;
+            }
+        }
+}
+
+// Ids of the cameras that see the point, in increasing order
+int CameraLayout::camerasContaining(double x, double y, int* ids) const
+{
+    int gx = (int) floor((x - gridMinX)/cellSizeX);
+    int gy = (int) floor((y - gridMinY)/cellSizeY);
+    uint32_t full = 0, partial;
+    if (gx < 0 || gy < 0 || gx >= CAMERA_GRID_SIZE || gy >= CAMERA_GRID_SIZE)
+        partial = (cameraCount >= 32) ? 0xffffffffu : (1u << cameraCount) - 1;
+    else
+    {
+        full = fullMask[gx][gy];
+        partial = partialMask[gx][gy];
+    }
+    int n = 0;
+    for (int i = 0; i < cameraCount; i++)
+    {
+        uint32_t bit = 1u << i;
+        if (full & bit) ids[n++] = i;
+        else if (partial & bit)
+        {
+            const CameraRegion &r = regions[i];
+            if (x > r.minX && x < r.maxX && y > r.minY && y < r.maxY) ids[n++] = i;
+        }
+    }
+    return n;
+}
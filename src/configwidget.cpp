@@ -99,8 +99,13 @@ ConfigWidget::ConfigWidget()
     phys_vars->addChild(worldp_vars);
         ADD_VALUE(worldp_vars,Double,DesiredFPS,65,"Desired FPS")
         ADD_VALUE(worldp_vars,Bool,SyncWithGL,false,"Realtime physics")
+        ADD_VALUE(worldp_vars,Bool,ClockAnchoredToWall,true,"Keep the simulated clock of the timestamps in step with wall time")
         ADD_VALUE(worldp_vars,Double,DeltaTime,0.016,"ODE time step")
+        ADD_VALUE(worldp_vars,Double,ControllerRate,1000,"Robot controller rate (Hz, at most once per physics substep), 0: every substep")
+        ADD_VALUE(worldp_vars,Double,CommandTimeout,0.5,"Robot command timeout (s), 0: never")
+        ADD_VALUE(worldp_vars,Double,CommandRampRate,200,"Wheel deceleration after command timeout (rad/s^2)")
         ADD_VALUE(worldp_vars,Double,Gravity,9.8,"Gravity")
+        ADD_VALUE(worldp_vars,Bool,MotorTrace,false,"Trace motor model")
   VarListPtr ballp_vars(new VarList("Ball"));
     phys_vars->addChild(ballp_vars);
         ADD_VALUE(ballp_vars,Double,BallMass,0.043,"Ball mass");
@@ -110,6 +115,14 @@ ConfigWidget::ConfigWidget()
         ADD_VALUE(ballp_vars,Double,BallBounceVel,0.1,"Ball-ground bounce min velocity")
         ADD_VALUE(ballp_vars,Double,BallLinearDamp,0.004,"Ball linear damping")
         ADD_VALUE(ballp_vars,Double,BallAngularDamp,0.004,"Ball angular damping")
+  VarListPtr dribp_vars(new VarList("Dribbler"));
+    phys_vars->addChild(dribp_vars);
+        ADD_ENUM(StringEnum,DribbleMode,"Roller torque","Dribble mode")
+        ADD_TO_ENUM(DribbleMode,"Roller torque")
+        ADD_TO_ENUM(DribbleMode,"Soft joint")
+        ADD_TO_ENUM(DribbleMode,"Kinematic")
+        END_ENUM(dribp_vars,DribbleMode)
+        ADD_VALUE(dribp_vars,Double,DribbleReleaseForce,2.0,"Lateral force releasing the ball (N)")
   VarListPtr comm_vars(new VarList("Communication"));
   world.push_back(comm_vars);
     ADD_VALUE(comm_vars,String,VisionMulticastAddr,"127.0.0.1","Vision multicast address")  //SSL Vision: "224.5.23.2"
@@ -117,15 +130,51 @@ ConfigWidget::ConfigWidget()
     ADD_VALUE(comm_vars,Int,CommandListenPort,20011,"Command listen port")
     ADD_VALUE(comm_vars,Int,BlueStatusSendPort,30011,"Blue Team status send port")
     ADD_VALUE(comm_vars,Int,YellowStatusSendPort,30012,"Yellow Team status send port")
+    ADD_VALUE(comm_vars,Bool,ExtendedStatus,false,"Extended robot status (4 bytes instead of 1)")
     ADD_VALUE(comm_vars,Int,sendDelay,0,"Sending delay (milliseconds)")
-    ADD_VALUE(comm_vars,Int,nCameras,1,"amount of cameras (1, 2, 4 or 8)")
+    ADD_VALUE(comm_vars,Double,sendJitter,0,"Sending delay jitter (milliseconds)")
+    ADD_ENUM(StringEnum,sendJitterModel,"Gaussian","Sending delay jitter distribution")
+    ADD_TO_ENUM(sendJitterModel,"Gaussian")
+    ADD_TO_ENUM(sendJitterModel,"Uniform")
+    ADD_TO_ENUM(sendJitterModel,"Exponential")
+    END_ENUM(comm_vars,sendJitterModel)
+    ADD_VALUE(comm_vars,Bool,VisionThread,false,"Build and send vision in a separate thread")
+    ADD_VALUE(comm_vars,Int,nCameras,1,"amount of cameras (at most 16)")
+    ADD_VALUE(comm_vars,Double,CameraOverlap,1.0,"Overlap of neighbouring cameras (m)")
+    ADD_VALUE(comm_vars,String,CameraLayoutFile,"","Camera layout file in config/, empty: tile the field")
+    ADD_VALUE(comm_vars,Double,CameraHeight,4.0,"Height of the cameras above the field (m)")
+    ADD_VALUE(comm_vars,Bool,Occlusion,false,"Hide the ball from cameras when a robot is in the line of sight")
+    ADD_VALUE(comm_vars,Double,CameraRate,0,"Camera capture rate on simulated time (Hz), 0: every physics frame")
+    ADD_VALUE(comm_vars,Double,CameraPhaseStep,0,"Capture phase offset between consecutive cameras (s)")
     ADD_VALUE(comm_vars,Int,sendGeometryEvery,120,"Send geometry every X frames")
+    ADD_VALUE(comm_vars,Int,VisionPayloadBudget,1400,"Largest vision datagram payload (bytes), larger detections are split, 0: no limit")
+    ADD_VALUE(comm_vars,String,VisionSubscribersFile,"","Additional vision receivers file in config/, empty: none")
+    VarListPtr transport_vars(new VarList("Local transport"));
+        comm_vars->addChild(transport_vars);
+        ADD_ENUM(StringEnum,VisionTransport,"UDP","Vision transport")
+        ADD_TO_ENUM(VisionTransport,"UDP")
+        ADD_TO_ENUM(VisionTransport,"Unix socket")
+        ADD_TO_ENUM(VisionTransport,"Shared memory")
+        END_ENUM(transport_vars,VisionTransport)
+        ADD_VALUE(transport_vars,String,VisionSocketPath,"/tmp/grsim-vision","Vision unix socket, or doorbell socket of the shared memory ring")
+        ADD_ENUM(StringEnum,CommandTransport,"UDP","Command transport")
+        ADD_TO_ENUM(CommandTransport,"UDP")
+        ADD_TO_ENUM(CommandTransport,"Unix socket")
+        END_ENUM(transport_vars,CommandTransport)
+        ADD_VALUE(transport_vars,String,CommandSocketPath,"/tmp/grsim-commands","Command unix socket")
+    VarListPtr truth_vars(new VarList("Ground truth"));
+        comm_vars->addChild(truth_vars);
+        ADD_VALUE(truth_vars,Bool,GroundTruth,false,"Send ground truth")
+        ADD_VALUE(truth_vars,String,GroundTruthAddr,"127.0.0.1","Ground truth address")
+        ADD_VALUE(truth_vars,Int,GroundTruthPort,10040,"Ground truth port")
+        ADD_VALUE(truth_vars,Double,GroundTruthRate,0,"Ground truth rate on simulated time (Hz), 0: every physics frame")
     VarListPtr gauss_vars(new VarList("Gaussian noise"));
         comm_vars->addChild(gauss_vars);
         ADD_VALUE(gauss_vars,Bool,noise,false,"Noise")
         ADD_VALUE(gauss_vars,Double,noiseDeviation_x,3,"Deviation for x values")
         ADD_VALUE(gauss_vars,Double,noiseDeviation_y,3,"Deviation for y values")
         ADD_VALUE(gauss_vars,Double,noiseDeviation_angle,2,"Deviation for angle values")
+        ADD_VALUE(gauss_vars,Int,noiseSeed,0,"Noise seed, 0: from the clock")
     VarListPtr vanishing_vars(new VarList("Vanishing probability"));
         comm_vars->addChild(vanishing_vars);
         ADD_VALUE(gauss_vars,Bool,vanishing,false,"Vanishing")
@@ -208,16 +257,30 @@ void ConfigDockWidget::closeEvent(QCloseEvent* event)
 
 void ConfigWidget::loadRobotsSettings()
 {
-    loadRobotSettings(YellowTeam().c_str());
-    yellowSettings = robotSettings;
-    loadRobotSettings(BlueTeam().c_str());
-    blueSettings = robotSettings;
+    robotModels.clear();
+    yellowSettings = loadRobotSettings(YellowTeam().c_str(), yellowModels);
+    blueSettings = loadRobotSettings(BlueTeam().c_str(), blueModels);
 }
 
-void ConfigWidget::loadRobotSettings(QString team)
+// Settings of one robot: the team config, unless its [Robots] section names another robot config for this id
+const RobotSettings& ConfigWidget::getRobotSettings(int team, int id)
+{
+    const QMap<int, QString> &models = (team == 0) ? blueModels : yellowModels;
+    if (!models.contains(id)) return (team == 0) ? blueSettings : yellowSettings;
+    QString model = models.value(id);
+    if (!robotModels.contains(model))
+    {
+        QMap<int, QString> unused;
+        robotModels[model] = loadRobotSettings(model, unused);
+    }
+    return robotModels[model];
+}
+
+RobotSettings ConfigWidget::loadRobotSettings(QString team, QMap<int, QString> &models)
 {
     QString ss = qApp->applicationDirPath()+QString("/../config/")+QString("%1.ini").arg(team);
     robot_settings = new QSettings(ss, QSettings::IniFormat);
+    RobotSettings robotSettings;
     robotSettings.RobotCenterFromKicker = robot_settings->value("Geometery/CenterFromKicker", 0.073).toDouble();
     robotSettings.RobotRadius = robot_settings->value("Geometery/Radius", 0.09).toDouble();
     robotSettings.RobotHeight = robot_settings->value("Geometery/Height", 0.13).toDouble();
@@ -243,4 +306,28 @@ void ConfigWidget::loadRobotSettings(QString team)
     robotSettings.WheelTangentFriction = robot_settings->value("Physics/WheelTangentFriction", 0.8f).toDouble();
     robotSettings.WheelPerpendicularFriction = robot_settings->value("Physics/WheelPerpendicularFriction", 0.05f).toDouble();
     robotSettings.Wheel_Motor_FMax = robot_settings->value("Physics/WheelMotorMaximumApplyingTorque", 0.2f).toDouble();
+
+    QString motorModel = robot_settings->value("Motor/Model", "ideal").toString();
+    robotSettings.MotorModel = (motorModel.toLower() == "dc") ? RobotSettings::DCMotor : RobotSettings::IdealMotor;
+    robotSettings.MotorVoltage = robot_settings->value("Motor/Voltage", 12.0).toDouble();
+    robotSettings.MotorResistance = robot_settings->value("Motor/Resistance", 1.2).toDouble();
+    robotSettings.MotorTorqueConstant = robot_settings->value("Motor/TorqueConstant", 0.0255).toDouble();
+    robotSettings.MotorGearRatio = robot_settings->value("Motor/GearRatio", 3.6).toDouble();
+    robotSettings.MotorCurrentLimit = robot_settings->value("Motor/CurrentLimit", 3.0).toDouble();
+    robotSettings.MotorSpeedGain = robot_settings->value("Motor/SpeedGain", 0.5).toDouble();
+    robotSettings.BatteryResistance = robot_settings->value("Motor/BatteryResistance", 0.1).toDouble();
+
+    robotSettings.KickerChargeTime = robot_settings->value("Kicker/ChargeTime", 0.0).toDouble();
+    robotSettings.KickerCapacitorEnergy = robot_settings->value("Kicker/CapacitorEnergy", 50.0).toDouble();
+    robotSettings.KickerEfficiency = robot_settings->value("Kicker/Efficiency", 0.03).toDouble();
+    robotSettings.KickerFlatDischargeTime = robot_settings->value("Kicker/FlatDischargeTime", 0.005).toDouble();
+    robotSettings.KickerChipDischargeTime = robot_settings->value("Kicker/ChipDischargeTime", 0.010).toDouble();
+
+    models.clear();
+    robot_settings->beginGroup("Robots");
+    QStringList ids = robot_settings->childKeys();
+    for (int i = 0; i < ids.size(); i++)
+        models[ids[i].toInt()] = robot_settings->value(ids[i]).toString();
+    robot_settings->endGroup();
+    return robotSettings;
 }
@@ -0,0 +1,105 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "delayline.h"
+#include "net/robocup_ssl_server.h"
+
+DelayLine::DelayLine()
+{
+    for (int i = 0; i < DELAY_LINE_CAPACITY; i++) ring[i].waiting = 0;
+    tail = span = queued = 0;
+}
+
+// Queues the packet for the destinations set in the mask, release holds the release time of each destination.
+// Returns the size of the datagram, or -1 when the packet is dropped because the ring is full.
+int DelayLine::push(const google::protobuf::MessageLite& packet, const double* release, uint32_t destinations)
+{
+    if (span == DELAY_LINE_CAPACITY || destinations == 0) return -1;
+    Slot &slot = ring[(tail + span) % DELAY_LINE_CAPACITY];
+    if (!packet.SerializeToString(&slot.data)) return -1;
+    for (int d = 0; d < DELAY_LINE_DESTINATIONS; d++)
+        if (destinations & (1u << d)) slot.release[d] = release[d];
+    slot.waiting = destinations;
+    span++;
+    queued++;
+    return slot.data.size();
+}
+
+// Sends every datagram due at now in batches per destination, servers[d] being destination d, returns how many
+// datagrams were sent. Destinations without a server drop their datagrams. UDP destinations send through socket
+// when one is given, see RoboCupSSLServer::send().
+int DelayLine::send(double now, RoboCupSSLServer* const* servers, int count, SendLateness* lateness, QUdpSocket* socket)
+{
+    const char* data[DELAY_LINE_BATCH];
+    int sizes[DELAY_LINE_BATCH];
+    int sent = 0;
+    for (int d = 0; d < DELAY_LINE_DESTINATIONS; d++)
+    {
+        RoboCupSSLServer* server = d < count ? servers[d] : 0;
+        int n = 0;
+        for (int i = 0; i < span; i++)
+        {
+            Slot &slot = ring[(tail + i) % DELAY_LINE_CAPACITY];
+            if (!(slot.waiting & (1u << d)) || slot.release[d] > now) continue;
+            slot.waiting &= ~(1u << d);
+            if (slot.waiting == 0) queued--;
+            if (!server) continue;
+            data[n] = slot.data.data();
+            sizes[n] = slot.data.size();
+            if (lateness)
+            {
+                lateness->sum += now - slot.release[d];
+                if (now - slot.release[d] > lateness->max) lateness->max = now - slot.release[d];
+                lateness->count++;
+            }
+            sent++;
+            if (++n == DELAY_LINE_BATCH)
+            {
+                server->send(data, sizes, n, socket);
+                n = 0;
+            }
+        }
+        if (n > 0) server->send(data, sizes, n, socket);
+    }
+    while (span > 0 && ring[tail].waiting == 0)
+    {
+        tail = (tail + 1) % DELAY_LINE_CAPACITY;
+        span--;
+    }
+    return sent;
+}
+
+// Earliest release time of the queued datagrams, a far future time when there are none
+double DelayLine::nextRelease() const
+{
+    double next = 1e100;
+    for (int i = 0; i < span; i++)
+    {
+        const Slot &slot = ring[(tail + i) % DELAY_LINE_CAPACITY];
+        for (int d = 0; d < DELAY_LINE_DESTINATIONS; d++)
+            if ((slot.waiting & (1u << d)) && slot.release[d] < next) next = slot.release[d];
+    }
+    return next;
+}
+
+void DelayLine::clear()
+{
+    for (int i = 0; i < DELAY_LINE_CAPACITY; i++) ring[i].waiting = 0;
+    tail = span = queued = 0;
+}
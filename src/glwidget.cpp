@@ -135,17 +135,17 @@ GLWidget::~GLWidget()
 void GLWidget::moveRobot()
 {
     ssl->show3DCursor = true;
-    ssl->cursor_radius = cfg->robotSettings.RobotRadius;
     state = 1;
     moving_robot_id = clicked_robot;
+    if (moving_robot_id != -1) ssl->cursor_radius = ssl->robots[moving_robot_id]->settings->RobotRadius;
 }
 
 void GLWidget::unselectRobot()
 {
     ssl->show3DCursor = false;
-    ssl->cursor_radius = cfg->robotSettings.RobotRadius;
     state = 0;
     moving_robot_id= ssl->robotIndex(Current_robot,Current_team);
+    ssl->cursor_radius = ssl->robots[moving_robot_id]->settings->RobotRadius;
 }
 
 void GLWidget::selectRobot()
@@ -193,9 +193,9 @@ void GLWidget::resetCurrentRobot()
 void GLWidget::moveCurrentRobot()
 {
     ssl->show3DCursor = true;
-    ssl->cursor_radius = cfg->robotSettings.RobotRadius;
     state = 1;
     moving_robot_id = ssl->robotIndex(Current_robot,Current_team);
+    ssl->cursor_radius = ssl->robots[moving_robot_id]->settings->RobotRadius;
 }
 
 void GLWidget::moveBall()
@@ -222,6 +222,7 @@ void GLWidget::mousePressEvent(QMouseEvent *event)
         }
         else if (state==2)
         {
+            ssl->releaseBall();
             ssl->ball->setBodyPosition(ssl->cursor_x,ssl->cursor_y,cfg->BallRadius()*1.1*20.0);
             dBodySetAngularVel(ssl->ball->body,0,0,0);
             dBodySetLinearVel(ssl->ball->body,0,0,0);
@@ -458,6 +459,7 @@ void GLWidget::changeCameraMode()
 
 void GLWidget::putBall(dReal x,dReal y)
 {
+    ssl->releaseBall();
     ssl->ball->setBodyPosition(x,y,0.3);
     dBodySetLinearVel(ssl->ball->body,0,0,0);
     dBodySetAngularVel(ssl->ball->body,0,0,0);
@@ -591,6 +593,7 @@ void GLWidget::reform(int team,const QString& act)
 
 void GLWidget::moveBallHere()
 {
+    ssl->releaseBall();
     ssl->ball->setBodyPosition(ssl->cursor_x,ssl->cursor_y,cfg->BallRadius()*2);
     dBodySetLinearVel(ssl->ball->body, 0.0, 0.0, 0.0);
     dBodySetAngularVel(ssl->ball->body, 0.0, 0.0, 0.0);
@@ -26,6 +26,8 @@ void initLogger(void* v)
 
 void logStatus(QString s,QColor c)
 {    
+    printer->mutex.lock();
     printer->textBuffer.enqueue(CStatusText(s,c));
+    printer->mutex.unlock();
 }
 
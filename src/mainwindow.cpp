@@ -31,6 +31,8 @@ Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
 #include <QApplication>
 #include <QDir>
 #include <QClipboard>
+#include <QFile>
+#include <QSettings>
 
 #include <QStatusBar>
 #include <QMessageBox>
@@ -75,16 +77,23 @@ MainWindow::MainWindow(QWidget *parent)
     glwidget->resize(512,512);
 
     visionServer = NULL;
+    groundTruthServer = NULL;
     commandSocket = NULL;
+    localCommandSocket = NULL;
     blueStatusSocket = NULL;
     yellowStatusSocket = NULL;
     reconnectVisionSocket();
+    reconnectGroundTruthSocket();
+    visionSubscriberCount = 0;
+    reconnectVisionSubscribers();
     reconnectCommandSocket();
     reconnectBlueStatusSocket();
     reconnectYellowStatusSocket();
 
     glwidget->ssl->visionServer = visionServer;
+    glwidget->ssl->groundTruthServer = groundTruthServer;
     glwidget->ssl->commandSocket = commandSocket;
+    glwidget->ssl->localCommandSocket = localCommandSocket;
     glwidget->ssl->blueStatusSocket = blueStatusSocket;
     glwidget->ssl->yellowStatusSocket = yellowStatusSocket;
 
@@ -99,6 +108,7 @@ MainWindow::MainWindow(QWidget *parent)
     selectinglabel = new QLabel(this);
     vanishlabel = new QLabel("Vanishing",this);
     noiselabel = new QLabel("Gaussian noise",this);
+    visionsendlabel = new QLabel(this);
     fpslabel->setFrameStyle(QFrame::Panel);
     physicsspslabel->setFrameStyle(QFrame::Panel);
     physicsaveragesteptimelabel->setFrameStyle(QFrame::Panel);
@@ -106,6 +116,7 @@ MainWindow::MainWindow(QWidget *parent)
     selectinglabel->setFrameStyle(QFrame::Panel);
     vanishlabel->setFrameStyle(QFrame::Panel);
     noiselabel->setFrameStyle(QFrame::Panel);
+    visionsendlabel->setFrameStyle(QFrame::Panel);
     statusBar()->addWidget(fpslabel);
     statusBar()->addWidget(physicsspslabel);
     statusBar()->addWidget(physicsaveragesteptimelabel);
@@ -113,6 +124,7 @@ MainWindow::MainWindow(QWidget *parent)
     statusBar()->addWidget(selectinglabel);
     statusBar()->addWidget(vanishlabel);
     statusBar()->addWidget(noiselabel);
+    statusBar()->addWidget(visionsendlabel);
     /* Menus */
 
     QMenu *fileMenu = new QMenu("&File");
@@ -214,6 +226,7 @@ MainWindow::MainWindow(QWidget *parent)
     QObject::connect(configwidget->v_BallLinearDamp.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(changeBallDamping()));
     QObject::connect(configwidget->v_BallAngularDamp.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(changeBallDamping()));
     QObject::connect(configwidget->v_Gravity.get(),  SIGNAL(wasEdited(VarPtr)), this, SLOT(changeGravity()));
+    QObject::connect(configwidget->v_MotorTrace.get(),  SIGNAL(wasEdited(VarPtr)), this, SLOT(dumpMotorTrace()));
 
     //geometry config vars
     QObject::connect(configwidget->v_DesiredFPS.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(changeTimer()));
@@ -255,11 +268,19 @@ MainWindow::MainWindow(QWidget *parent)
 
     QObject::connect(configwidget->v_YellowTeam.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(restartSimulator()));
     QObject::connect(configwidget->v_BlueTeam.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(restartSimulator()));
+    QObject::connect(configwidget->v_VisionThread.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(restartSimulator()));
 
     //network
     QObject::connect(configwidget->v_VisionMulticastAddr.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectVisionSocket()));
     QObject::connect(configwidget->v_VisionMulticastPort.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectVisionSocket()));
+    QObject::connect(configwidget->v_VisionSubscribersFile.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectVisionSubscribers()));
+    QObject::connect(configwidget->v_GroundTruthAddr.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectGroundTruthSocket()));
+    QObject::connect(configwidget->v_GroundTruthPort.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectGroundTruthSocket()));
     QObject::connect(configwidget->v_CommandListenPort.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectCommandSocket()));
+    QObject::connect(configwidget->v_VisionTransport.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectVisionSocket()));
+    QObject::connect(configwidget->v_VisionSocketPath.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectVisionSocket()));
+    QObject::connect(configwidget->v_CommandTransport.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectCommandSocket()));
+    QObject::connect(configwidget->v_CommandSocketPath.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectCommandSocket()));
     QObject::connect(configwidget->v_BlueStatusSendPort.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectBlueStatusSocket()));
     QObject::connect(configwidget->v_YellowStatusSendPort.get(), SIGNAL(wasEdited(VarPtr)), this, SLOT(reconnectYellowStatusSocket()));
     timer->start();
@@ -317,6 +338,27 @@ void MainWindow::changeGravity()
     dWorldSetGravity (glwidget->ssl->p->world,0,0,-configwidget->Gravity());
 }
 
+// Logs the motor model trace of every robot, oldest entry first, once tracing is switched off, and starts the
+// next trace empty
+void MainWindow::dumpMotorTrace()
+{
+    if (configwidget->MotorTrace()) return;
+    static const char* events[] = {"two wheel rotation", "pwm output", "wheel speed"};
+    for (int team=0;team<2;team++)
+        for (int k=0;k<configwidget->Robots_Count();k++)
+        {
+            MotorTrace &trace = glwidget->ssl->robots[robotIndex(k,team)]->motorTrace;
+            for (int i=0;i<trace.count();i++)
+            {
+                const MotorTrace::Entry &e = trace.at(i);
+                logStatus(QString("%1 %2 %3: %4 %5 %6 %7").arg(team==0 ? "Blue" : "Yellow").arg(k).arg(events[e.event])
+                          .arg(e.values[0], 0, 'f', 3).arg(e.values[1], 0, 'f', 3).arg(e.values[2], 0, 'f', 3).arg(e.values[3], 0, 'f', 3),
+                          QColor("black"));
+            }
+            trace.clear();
+        }
+}
+
 int MainWindow::robotIndex(int robot,int team)
 {
     return glwidget->ssl->robotIndex(robot, team);
@@ -350,6 +392,9 @@ void MainWindow::update()
     aa[2]=(vv[2]-lvv[2])/configwidget->DeltaTime();
     robotwidget->vellabel->setText(QString::number(sqrt(vv[0]*vv[0]+vv[1]*vv[1]+vv[2]*vv[2]),'f',3));
     robotwidget->acclabel->setText(QString::number(sqrt(aa[0]*aa[0]+aa[1]*aa[1]+aa[2]*aa[2]),'f',3));
+    const RobotCommand& command = glwidget->ssl->commands[R];
+    if (command.mode == RobotCommand::NONE) robotwidget->cmdagelabel->setText("-");
+    else robotwidget->cmdagelabel->setText(QString("%1 ms%2").arg((int)(command.age*1000)).arg(command.stale ? " (stale)" : ""));
     lvv[0]=vv[0];
     lvv[1]=vv[1];
     lvv[2]=vv[2];
@@ -375,6 +420,8 @@ void MainWindow::update()
     else selectinglabel->setVisible(false);
     vanishlabel->setVisible(configwidget->vanishing());
     noiselabel->setVisible(configwidget->noise());
+    if (visionServer != NULL)
+        visionsendlabel->setText(QString("Vision: %1 datagrams in %2 send calls, %3").arg(visionServer->datagramsSent()).arg(visionServer->sendCalls()).arg(glwidget->ssl->visionSender->report()));
     cursorlabel->setText(QString("Cursor: [X=%1;Y=%2;Z=%3]").arg(dRealToStr(glwidget->ssl->cursor_x)).arg(dRealToStr(glwidget->ssl->cursor_y)).arg(dRealToStr(glwidget->ssl->cursor_z)));
     statusWidget->update();
 }
@@ -430,7 +477,10 @@ void MainWindow::restartSimulator()
     glwidget->ssl = new SSLWorld(glwidget,glwidget->cfg,glwidget->forms[2],glwidget->forms[2]);
     glwidget->ssl->glinit();
     glwidget->ssl->visionServer = visionServer;
+    glwidget->ssl->visionSender->setSubscribers(visionSubscribers, visionSubscriberCount);
+    glwidget->ssl->groundTruthServer = groundTruthServer;
     glwidget->ssl->commandSocket = commandSocket;
+    glwidget->ssl->localCommandSocket = localCommandSocket;
     glwidget->ssl->blueStatusSocket = blueStatusSocket;
     glwidget->ssl->yellowStatusSocket = yellowStatusSocket;
 }
@@ -543,10 +593,32 @@ void MainWindow::reconnectCommandSocket()
         QObject::disconnect(commandSocket,SIGNAL(readyRead()),this,SLOT(recvActions()));
         delete commandSocket;
     }
+    delete localCommandSocket;
+    localCommandSocket = NULL;
+    // the UDP socket stays unbound while commands come over the unix socket
     commandSocket = new QUdpSocket(this);
-    if (commandSocket->bind(QHostAddress::Any,configwidget->CommandListenPort()))
-        logStatus(QString("Command listen port binded on: %1").arg(configwidget->CommandListenPort()),QColor("green"));
-    QObject::connect(commandSocket,SIGNAL(readyRead()),this,SLOT(recvActions()));
+    if (configwidget->CommandTransport() == "Unix socket")
+    {
+        QString path = QString::fromStdString(configwidget->CommandSocketPath());
+        localCommandSocket = new LocalDatagramSocket(this);
+        if (localCommandSocket->bind(path))
+            logStatus(QString("Command unix socket bound on: %1").arg(path),QColor("green"));
+        else
+            logStatus(QString("Could not bind command unix socket on: %1").arg(path),QColor("red"));
+        QObject::connect(localCommandSocket,SIGNAL(readyRead()),this,SLOT(recvLocalActions()));
+    }
+    else
+    {
+        if (commandSocket->bind(QHostAddress::Any,configwidget->CommandListenPort()))
+            logStatus(QString("Command listen port binded on: %1").arg(configwidget->CommandListenPort()),QColor("green"));
+        QObject::connect(commandSocket,SIGNAL(readyRead()),this,SLOT(recvActions()));
+    }
+    // the world keeps the sockets it was given, they are replaced here
+    if (glwidget->ssl != NULL)
+    {
+        glwidget->ssl->commandSocket = commandSocket;
+        glwidget->ssl->localCommandSocket = localCommandSocket;
+    }
 }
 
 void MainWindow::reconnectVisionSocket()
@@ -556,14 +628,74 @@ void MainWindow::reconnectVisionSocket()
     }
     visionServer->change_address(configwidget->VisionMulticastAddr());
     visionServer->change_port(configwidget->VisionMulticastPort());
+    RoboCupSSLServer::Transport transport = RoboCupSSLServer::UDP;
+    if (configwidget->VisionTransport() == "Unix socket") transport = RoboCupSSLServer::UNIX_SOCKET;
+    else if (configwidget->VisionTransport() == "Shared memory") transport = RoboCupSSLServer::SHARED_MEMORY;
+    QString path = QString::fromStdString(configwidget->VisionSocketPath());
+    if (!visionServer->change_transport(transport, configwidget->VisionSocketPath()))
+        logStatus(QString("Could not open vision transport on: %1, sending on UDP").arg(path),QColor("red"));
+    else if (transport != RoboCupSSLServer::UDP)
+    {
+        logStatus(QString("Vision server connected on: %1").arg(path),QColor("green"));
+        return;
+    }
     logStatus(QString("Vision server connected on: %1").arg(configwidget->VisionMulticastPort()),QColor("green"));
 }
 
+void MainWindow::reconnectGroundTruthSocket()
+{
+    if (groundTruthServer == NULL) {
+        groundTruthServer = new RoboCupSSLServer(this);
+    }
+    groundTruthServer->change_address(configwidget->GroundTruthAddr());
+    groundTruthServer->change_port(configwidget->GroundTruthPort());
+    logStatus(QString("Ground truth server connected on: %1").arg(configwidget->GroundTruthPort()),QColor("green"));
+}
+
+// Additional vision receivers, read from an ini file in config/ with one group per receiver:
+// [Subscriber 0] Address, Port, Delay, Jitter (ms), Loss (probability) and Decimation (send every Nth frame)
+void MainWindow::reconnectVisionSubscribers()
+{
+    VisionSubscriber old[VISION_MAX_SUBSCRIBERS];
+    int oldCount = visionSubscriberCount;
+    for (int i = 0; i < oldCount; i++) old[i] = visionSubscribers[i];
+    visionSubscriberCount = 0;
+    QString file = QString::fromStdString(configwidget->VisionSubscribersFile());
+    QString filename = qApp->applicationDirPath() + QString("/../config/") + file;
+    if (!file.isEmpty() && !QFile::exists(filename))
+        logStatus(QString("Vision subscribers file not found: %1").arg(file),QColor("red"));
+    else if (!file.isEmpty())
+    {
+        QSettings settings(filename, QSettings::IniFormat);
+        for (int i = 0; i < VISION_MAX_SUBSCRIBERS; i++)
+        {
+            QString group = QString("Subscriber %1/").arg(i);
+            if (!settings.contains(group + "Port")) break;
+            VisionSubscriber &sub = visionSubscribers[visionSubscriberCount++];
+            sub.server = new RoboCupSSLServer(this, settings.value(group + "Port").toInt(),
+                                              settings.value(group + "Address", "127.0.0.1").toString().toStdString());
+            sub.delay = settings.value(group + "Delay", 0).toDouble();
+            sub.jitter = settings.value(group + "Jitter", 0).toDouble();
+            sub.loss = settings.value(group + "Loss", 0).toDouble();
+            sub.decimation = qMax(1, settings.value(group + "Decimation", 1).toInt());
+        }
+        logStatus(QString("Vision sent to %1 additional subscribers").arg(visionSubscriberCount),QColor("green"));
+    }
+    // the sender lets go of the old servers before they are deleted
+    glwidget->ssl->visionSender->setSubscribers(visionSubscribers, visionSubscriberCount);
+    for (int i = 0; i < oldCount; i++) delete old[i].server;
+}
+
 void MainWindow::recvActions()
 {
     glwidget->ssl->recvActions();
 }
 
+void MainWindow::recvLocalActions()
+{
+    glwidget->ssl->recvLocalActions();
+}
+
 void MainWindow::setIsGlEnabled(bool value)
 {
   glwidget->ssl->isGLEnabled = value;
@@ -0,0 +1,348 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "localtransport.h"
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <cstring>
+#include <cstddef>
+#include "logger.h"
+#ifdef HAVE_LINUX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define LOCAL_BATCH_SIZE 64
+#define SHM_RING_MAX_SUBSCRIBERS 16
+
+#ifdef HAVE_LINUX
+static bool toAddress(const QString& path, sockaddr_un& addr)
+{
+    QByteArray p = path.toLocal8Bit();
+    if (p.isEmpty() || p.size() >= (int) sizeof(addr.sun_path)) return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, p.constData(), p.size());
+    return true;
+}
+#endif
+
+LocalDatagramSocket::LocalDatagramSocket(QObject* parent) :
+    QObject(parent),
+    fd(-1),
+    notifier(NULL)
+{
+}
+
+LocalDatagramSocket::~LocalDatagramSocket()
+{
+#ifdef HAVE_LINUX
+    delete notifier;
+    if (fd != -1) ::close(fd);
+    if (!boundPath.isEmpty()) unlink(boundPath.toLocal8Bit().constData());
+#endif
+}
+
+bool LocalDatagramSocket::create()
+{
+#ifdef HAVE_LINUX
+    if (fd == -1) fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    return fd != -1;
+#else
+    return false;
+#endif
+}
+
+// A stale socket file left by a previous run is replaced
+bool LocalDatagramSocket::bind(const QString& path)
+{
+#ifdef HAVE_LINUX
+    sockaddr_un addr;
+    if (!toAddress(path, addr) || !create()) return false;
+    unlink(addr.sun_path);
+    if (::bind(fd, (sockaddr*) &addr, sizeof(addr)) != 0) return false;
+    boundPath = path;
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SIGNAL(readyRead()));
+    return true;
+#else
+    Q_UNUSED(path);
+    return false;
+#endif
+}
+
+bool LocalDatagramSocket::hasPendingDatagrams()
+{
+#ifdef HAVE_LINUX
+    char c;
+    return fd != -1 && recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) >= 0;
+#else
+    return false;
+#endif
+}
+
+int LocalDatagramSocket::readDatagram(char* data, int maxSize, QString* sender)
+{
+#ifdef HAVE_LINUX
+    sockaddr_un addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    int size = recvfrom(fd, data, maxSize, MSG_DONTWAIT, (sockaddr*) &addr, &len);
+    if (sender != NULL)
+    {
+        // unbound senders have no path and cannot be answered
+        if (size >= 0 && len > (socklen_t) offsetof(sockaddr_un, sun_path) && addr.sun_path[0] != 0)
+            *sender = QString::fromLocal8Bit(addr.sun_path);
+        else
+            sender->clear();
+    }
+    return size;
+#else
+    Q_UNUSED(data); Q_UNUSED(maxSize); Q_UNUSED(sender);
+    return -1;
+#endif
+}
+
+int LocalDatagramSocket::writeDatagrams(const char* const* data, const int* sizes, int count, const QString& path)
+{
+#ifdef HAVE_LINUX
+    sockaddr_un addr;
+    if (!toAddress(path, addr) || !create()) return -1;
+    mmsghdr msgs[LOCAL_BATCH_SIZE];
+    iovec iov[LOCAL_BATCH_SIZE];
+    int done = 0;
+    while (done < count)
+    {
+        int n = qMin(count - done, LOCAL_BATCH_SIZE);
+        memset(msgs, 0, n*sizeof(mmsghdr));
+        for (int i = 0; i < n; i++)
+        {
+            iov[i].iov_base = (void *) data[done + i];
+            iov[i].iov_len = sizes[done + i];
+            msgs[i].msg_hdr.msg_name = &addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(fd, msgs, n, MSG_DONTWAIT);
+        if (sent <= 0)
+        {
+            // nobody listening yet, or a client that does not keep up: the datagrams are lost as on UDP
+            if (errno == ENOENT || errno == ECONNREFUSED || errno == EAGAIN) break;
+            return -1;
+        }
+        done += sent;
+    }
+    return done;
+#else
+    Q_UNUSED(data); Q_UNUSED(sizes); Q_UNUSED(count); Q_UNUSED(path);
+    return -1;
+#endif
+}
+
+SharedMemoryRing::SharedMemoryRing(QObject* parent) :
+    QObject(parent),
+    listenFd(-1),
+    notifier(NULL),
+    header(NULL),
+    mapSize(0),
+    next(0)
+{
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+    close();
+}
+
+bool SharedMemoryRing::open(const QString& path)
+{
+#ifdef HAVE_LINUX
+    close();
+    sockaddr_un addr;
+    if (!toAddress(path, addr)) return false;
+    QString name = QString("/") + QFileInfo(path).fileName();
+    int shm = shm_open(name.toLocal8Bit().constData(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (shm == -1) return false;
+    size_t size = sizeof(ShmRingHeader) + (size_t) SHM_RING_SLOTS*(sizeof(ShmRingSlot) + SHM_RING_SLOT_SIZE);
+    void* map = MAP_FAILED;
+    if (ftruncate(shm, size) == 0)
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+    ::close(shm);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(name.toLocal8Bit().constData());
+        return false;
+    }
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(addr.sun_path);
+    if (listenFd == -1 || ::bind(listenFd, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(listenFd, 8) != 0)
+    {
+        if (listenFd != -1) ::close(listenFd);
+        listenFd = -1;
+        munmap(map, size);
+        shm_unlink(name.toLocal8Bit().constData());
+        return false;
+    }
+    // the pages come zeroed from ftruncate, so every slot starts with seq 0
+    header = (ShmRingHeader*) map;
+    header->slotCount = SHM_RING_SLOTS;
+    header->slotSize = SHM_RING_SLOT_SIZE;
+    header->written.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SHM_RING_MAGIC;
+    mapSize = size;
+    next = 0;
+    doorPath = path;
+    shmName = name;
+    notifier = new QSocketNotifier(listenFd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(acceptSubscriber()));
+    return true;
+#else
+    Q_UNUSED(path);
+    return false;
+#endif
+}
+
+void SharedMemoryRing::close()
+{
+#ifdef HAVE_LINUX
+    mutex.lock();
+    for (int i = 0; i < subs.size(); i++)
+    {
+        ::close(subs[i].connection);
+        ::close(subs[i].doorbell);
+    }
+    subs.clear();
+    mutex.unlock();
+    delete notifier;
+    notifier = NULL;
+    if (listenFd != -1)
+    {
+        ::close(listenFd);
+        unlink(doorPath.toLocal8Bit().constData());
+        listenFd = -1;
+    }
+    if (header != NULL)
+    {
+        munmap(header, mapSize);
+        shm_unlink(shmName.toLocal8Bit().constData());
+        header = NULL;
+    }
+#endif
+}
+
+bool SharedMemoryRing::write(const char* data, int size)
+{
+    if (header == NULL || size > SHM_RING_SLOT_SIZE) return false;
+    uint64_t n = next++;
+    char* base = (char*) (header + 1) + (n % SHM_RING_SLOTS)*(sizeof(ShmRingSlot) + SHM_RING_SLOT_SIZE);
+    ShmRingSlot* slot = (ShmRingSlot*) base;
+    slot->seq.store(2*n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->size = size;
+    memcpy(base + sizeof(ShmRingSlot), data, size);
+    slot->seq.store(2*n + 2, std::memory_order_release);
+    header->written.store(n + 1, std::memory_order_release);
+    return true;
+}
+
+// One wakeup per subscriber for everything written since the last call
+void SharedMemoryRing::ringDoorbell()
+{
+#ifdef HAVE_LINUX
+    uint64_t one = 1;
+    mutex.lock();
+    for (int i = 0; i < subs.size(); i++)
+        if (::write(subs[i].doorbell, &one, sizeof(one)) < 0) {}
+    mutex.unlock();
+#endif
+}
+
+int SharedMemoryRing::subscribers()
+{
+    mutex.lock();
+    int n = subs.size();
+    mutex.unlock();
+    return n;
+}
+
+// Hands every new client its own eventfd, and drops the clients that hung up since the last one came
+void SharedMemoryRing::acceptSubscriber()
+{
+#ifdef HAVE_LINUX
+    int connection;
+    while ((connection = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        mutex.lock();
+        for (int i = subs.size() - 1; i >= 0; i--)
+        {
+            char c;
+            if (recv(subs[i].connection, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+            {
+                ::close(subs[i].connection);
+                ::close(subs[i].doorbell);
+                subs.remove(i);
+            }
+        }
+        int doorbell = subs.size() < SHM_RING_MAX_SUBSCRIBERS ? eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) : -1;
+        mutex.unlock();
+        if (doorbell == -1)
+        {
+            ::close(connection);
+            logStatus(QString("Shared memory vision: subscriber refused"), QColor("red"));
+            continue;
+        }
+        QByteArray name = shmName.toLocal8Bit();
+        iovec iov;
+        iov.iov_base = name.data();
+        iov.iov_len = name.size();
+        char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &doorbell, sizeof(int));
+        if (sendmsg(connection, &msg, MSG_NOSIGNAL) < 0)
+        {
+            ::close(connection);
+            ::close(doorbell);
+            continue;
+        }
+        Subscriber s;
+        s.connection = connection;
+        s.doorbell = doorbell;
+        mutex.lock();
+        subs.append(s);
+        mutex.unlock();
+        logStatus(QString("Shared memory vision: subscriber connected"), QColor("green"));
+    }
+#endif
+}
@@ -23,6 +23,14 @@
 #include <QtNetwork>
 #include <iostream>
 #include "logger.h"
+#include "localtransport.h"
+#ifdef HAVE_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <cstring>
+#endif
+
+#define SEND_BATCH_SIZE 64
 
 using namespace std;
 
@@ -30,7 +38,13 @@ RoboCupSSLServer::RoboCupSSLServer(QObject *parent, const quint16 &port, const s
     _socket(new QUdpSocket(parent)),
     _port(port),
     _net_address(new QHostAddress(QString(net_address.c_str()))),
-    _net_interface(new QNetworkInterface(QNetworkInterface::interfaceFromName(QString(net_interface.c_str()))))
+    _net_interface(new QNetworkInterface(QNetworkInterface::interfaceFromName(QString(net_interface.c_str())))),
+    _datagrams(0),
+    _send_calls(0),
+    _transport(UDP),
+    _parent(parent),
+    _local(NULL),
+    _ring(NULL)
 {
     _socket->setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
 }
@@ -40,25 +54,56 @@ RoboCupSSLServer::~RoboCupSSLServer()
     mutex.lock();
     mutex.unlock();
     delete _socket;
+    delete _local;
+    delete _ring;
     delete _net_address;
     delete _net_interface;
 }
 
 void RoboCupSSLServer::change_port(const quint16 & port)
 {
+    mutex.lock();
     _port = port;
+    mutex.unlock();
 }
 
 void RoboCupSSLServer::change_address(const string & net_address)
 {
+    mutex.lock();
     delete _net_address;
     _net_address = new QHostAddress(QString(net_address.c_str()));
+    mutex.unlock();
 }
 
 void RoboCupSSLServer::change_interface(const string & net_interface)
 {
+    mutex.lock();
     delete _net_interface;
     _net_interface = new QNetworkInterface(QNetworkInterface::interfaceFromName(QString(net_interface.c_str())));
+    mutex.unlock();
+}
+
+// UDP keeps using the address and port, the local transports send to path instead: the receiving
+// socket for UNIX_SOCKET, the doorbell socket for SHARED_MEMORY. Has to be called from the GUI thread.
+bool RoboCupSSLServer::change_transport(Transport transport, const string & path)
+{
+    mutex.lock();
+    delete _local;
+    delete _ring;
+    _local = NULL;
+    _ring = NULL;
+    _transport = transport;
+    _path = QString::fromStdString(path);
+    bool success = true;
+    if (transport == UNIX_SOCKET)
+        _local = new LocalDatagramSocket(_parent);
+    else if (transport == SHARED_MEMORY) {
+        _ring = new SharedMemoryRing(_parent);
+        success = _ring->open(_path);
+    }
+    if (!success) _transport = UDP;
+    mutex.unlock();
+    return success;
 }
 
 bool RoboCupSSLServer::send(const SSL_WrapperPacket & packet)
@@ -73,17 +118,106 @@ bool RoboCupSSLServer::send(const SSL_WrapperPacket & packet)
         return false;
     }
 
+    return send(datagram.constData(), datagram.size());
+}
+
+// The socket of the server belongs to the GUI thread. Other threads pass a UDP socket created in the thread,
+// which is then used in its place.
+bool RoboCupSSLServer::send(const char * data, int size, QUdpSocket * socket)
+{
     mutex.lock();
-    quint64 bytes_sent = _socket->writeDatagram(datagram, *_net_address, _port);
+    // the batch send takes the lock again and handles every transport, change_transport may run in between
+    if (_transport != UDP) {
+        mutex.unlock();
+        return send(&data, &size, 1, socket);
+    }
+    if (socket == NULL) socket = _socket;
+    quint64 bytes_sent = socket->writeDatagram(data, size, *_net_address, _port);
+    _send_calls++;
     mutex.unlock();
-    if (bytes_sent != datagram.size()) {
-        logStatus(QString("Sending UDP datagram failed (maybe too large?). Size was: %1 byte(s).").arg(datagram.size()), QColor("red"));
+    if (bytes_sent != size) {
+        logStatus(QString("Sending UDP datagram failed (maybe too large?). Size was: %1 byte(s).").arg(size), QColor("red"));
         return false;
     }
+    _datagrams++;
 
     return true;
 }
 
+// Sends count datagrams at once. On Linux they leave with one sendmmsg call per SEND_BATCH_SIZE datagrams
+// through the socket of Qt, once Qt has created it with the first datagram. Otherwise, and for IPv6
+// destinations, every datagram is written through Qt.
+bool RoboCupSSLServer::send(const char * const * data, const int * sizes, int count, QUdpSocket * socket)
+{
+    if (socket == NULL) socket = _socket;
+    mutex.lock();
+    if (_transport == UNIX_SOCKET) {
+        int sent = _local->writeDatagrams(data, sizes, count, _path);
+        _send_calls++;
+        if (sent > 0) _datagrams += sent;
+        mutex.unlock();
+        if (sent < 0) {
+            logStatus(QString("Sending to unix socket %1 failed.").arg(_path), QColor("red"));
+            return false;
+        }
+        return true;
+    }
+    if (_transport == SHARED_MEMORY) {
+        bool success = true;
+        for (int i = 0; i < count; i++) {
+            if (_ring->write(data[i], sizes[i])) _datagrams++;
+            else success = false;
+        }
+        _ring->ringDoorbell();
+        _send_calls++;
+        mutex.unlock();
+        if (!success)
+            logStatus(QString("Datagram too large for the shared memory ring."), QColor("red"));
+        return success;
+    }
+#ifdef HAVE_LINUX
+    int fd = socket->socketDescriptor();
+    if (fd != -1 && _net_address->protocol() == QAbstractSocket::IPv4Protocol) {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(_port);
+        addr.sin_addr.s_addr = htonl(_net_address->toIPv4Address());
+        mmsghdr msgs[SEND_BATCH_SIZE];
+        iovec iov[SEND_BATCH_SIZE];
+        int done = 0;
+        while (done < count) {
+            int n = qMin(count - done, SEND_BATCH_SIZE);
+            memset(msgs, 0, n*sizeof(mmsghdr));
+            for (int i = 0; i < n; i++) {
+                iov[i].iov_base = (void *) data[done + i];
+                iov[i].iov_len = sizes[done + i];
+                msgs[i].msg_hdr.msg_name = &addr;
+                msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int sent = sendmmsg(fd, msgs, n, 0);
+            _send_calls++;
+            if (sent <= 0) break;
+            _datagrams += sent;
+            done += sent;
+        }
+        mutex.unlock();
+        if (done < count) {
+            logStatus(QString("Sending UDP datagrams failed, %1 of %2 sent.").arg(done).arg(count), QColor("red"));
+            return false;
+        }
+        return true;
+    }
+#endif
+    mutex.unlock();
+    bool success = true;
+    for (int i = 0; i < count; i++)
+        if (!send(data[i], sizes[i], socket)) success = false;
+    return success;
+}
+
 bool RoboCupSSLServer::send(const SSL_DetectionFrame & frame)
 {
     SSL_WrapperPacket pkt;
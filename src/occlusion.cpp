@@ -0,0 +1,89 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+OcclusionGrid::OcclusionGrid()
+{
+    clear();
+}
+
+void OcclusionGrid::clear()
+{
+    for (int i = 0; i < OCCLUSION_BUCKETS; i++) head[i] = -1;
+    count = 0;
+    maxRadius = maxHeight = 0;
+}
+
+// Cells far apart may share a bucket, they only cost extra exact tests
+int OcclusionGrid::bucket(int cx, int cy)
+{
+    return (((unsigned) cx*73856093u) ^ ((unsigned) cy*19349663u)) % OCCLUSION_BUCKETS;
+}
+
+void OcclusionGrid::add(double x, double y, double radius, double height)
+{
+    if (count == OCCLUSION_MAX_OBSTACLES) return;
+    Obstacle &o = obstacles[count];
+    o.x = x;
+    o.y = y;
+    o.radius = radius;
+    o.height = height;
+    int b = bucket((int) floor(x/OCCLUSION_CELL_SIZE), (int) floor(y/OCCLUSION_CELL_SIZE));
+    o.next = head[b];
+    head[b] = count++;
+    if (radius > maxRadius) maxRadius = radius;
+    if (height > maxHeight) maxHeight = height;
+}
+
+// Whether the segment from the point to the camera passes through a cylinder. Only the part of the segment below
+// the tallest cylinder is looked up in the grid, widened by the largest radius. A point inside a cylinder is
+// taken to be in the dribbler opening of that robot, which the cylinder does not model, and is not hidden by it.
+bool OcclusionGrid::occluded(double x, double y, double z, double camX, double camY, double camZ) const
+{
+    if (count == 0 || z >= maxHeight) return false;
+    double dx = camX - x, dy = camY - y, dz = camZ - z;
+    double reach = dz > maxHeight - z ? (maxHeight - z)/dz : 1;
+    double ex = x + reach*dx, ey = y + reach*dy;
+    int cx0 = (int) floor((std::min(x, ex) - maxRadius)/OCCLUSION_CELL_SIZE);
+    int cx1 = (int) floor((std::max(x, ex) + maxRadius)/OCCLUSION_CELL_SIZE);
+    int cy0 = (int) floor((std::min(y, ey) - maxRadius)/OCCLUSION_CELL_SIZE);
+    int cy1 = (int) floor((std::max(y, ey) + maxRadius)/OCCLUSION_CELL_SIZE);
+    double a = dx*dx + dy*dy;
+    for (int cx = cx0; cx <= cx1; cx++)
+        for (int cy = cy0; cy <= cy1; cy++)
+            for (int i = head[bucket(cx, cy)]; i != -1; i = obstacles[i].next)
+            {
+                const Obstacle &o = obstacles[i];
+                if (z >= o.height) continue;
+                double ox = x - o.x, oy = y - o.y;
+                double c = ox*ox + oy*oy - o.radius*o.radius;
+                if (c <= 0 || a == 0) continue;
+                double b = 2*(dx*ox + dy*oy);
+                double disc = b*b - 4*a*c;
+                if (disc < 0) continue;
+                // entry into the circle, the segment leaves the cylinder through its top at t = top
+                double t = (-b - sqrt(disc))/(2*a);
+                double top = dz > o.height - z ? (o.height - z)/dz : 1;
+                if (t >= 0 && t <= top) return true;
+            }
+    return false;
+}
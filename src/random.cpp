@@ -0,0 +1,56 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "random.h"
+
+#include <cmath>
+
+Random::Random(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void Random::seed(uint64_t seed)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        s[i] = z ^ (z >> 31);
+    }
+}
+
+// n standard normal deviates at once. The uniforms are drawn first, then turned into pairs of deviates by the
+// trigonometric Box-Muller transform, which unlike the polar method has no rejection loop: the number of uniforms
+// drawn only depends on n, so a seed gives the same noise whatever the values drawn.
+void Random::gaussian(double* out, int n)
+{
+    int pairs = n/2;
+    for (int i = 0; i < 2*pairs; i++) out[i] = uniform();
+    for (int i = 0; i < pairs; i++)
+    {
+        double r = sqrt(-2.0*log(1.0 - out[2*i]));
+        double a = 2.0*M_PI*out[2*i + 1];
+        out[2*i] = r*cos(a);
+        out[2*i + 1] = r*sin(a);
+    }
+    if (n % 2)
+        out[n - 1] = sqrt(-2.0*log(1.0 - uniform()))*cos(2.0*M_PI*uniform());
+}
@@ -17,14 +17,62 @@ Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
 */
 
 #include "robot.h"
-#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+RobotCommand::RobotCommand() {
+    mode = NONE;
+    vx = vy = vw = 0;
+    wheel[0] = wheel[1] = wheel[2] = wheel[3] = 0;
+    age = 0;
+    stale = false;
+    trajectoryPoints = 0;
+    trajectoryTime = 0;
+}
+
+// Reference pose and velocity of the trajectory at time t, cubic Hermite interpolation between the
+// waypoints, holding the first and last pose outside of the trajectory
+void RobotCommand::sampleTrajectory(dReal t, dReal* pose, dReal* vel) const {
+    const TrajectoryPoint* p = trajectory;
+    const int n = trajectoryPoints;
+    if (t <= p[0].t || n == 1 || t >= p[n - 1].t) {
+        const TrajectoryPoint &q = (t <= p[0].t) ? p[0] : p[n - 1];
+        pose[0] = q.x;
+        pose[1] = q.y;
+        pose[2] = q.w;
+        vel[0] = vel[1] = vel[2] = 0;
+        return;
+    }
+    int lo = 0, hi = n - 1;
+    while (hi - lo > 1) {
+        int mid = (lo + hi)/2;
+        if (p[mid].t <= t) lo = mid;
+        else hi = mid;
+    }
+    const TrajectoryPoint &a = p[lo], &b = p[hi];
+    dReal h = b.t - a.t;
+    dReal s = (t - a.t)/h, s2 = s*s, s3 = s2*s;
+    dReal h00 = 2*s3 - 3*s2 + 1, h10 = s3 - 2*s2 + s, h01 = - 2*s3 + 3*s2, h11 = s3 - s2;
+    dReal d00 = (6*s2 - 6*s)/h, d10 = 3*s2 - 4*s + 1, d01 = (- 6*s2 + 6*s)/h, d11 = 3*s2 - 2*s;
+    dReal bw = a.w + Robot::constrainAngle(b.w - a.w);
+    pose[0] = h00*a.x + h10*h*a.vx + h01*b.x + h11*h*b.vx;
+    pose[1] = h00*a.y + h10*h*a.vy + h01*b.y + h11*h*b.vy;
+    pose[2] = h00*a.w + h10*h*a.vw + h01*bw + h11*h*b.vw;
+    vel[0] = d00*a.x + d10*a.vx + d01*b.x + d11*b.vx;
+    vel[1] = d00*a.y + d10*a.vy + d01*b.y + d11*b.vy;
+    vel[2] = d00*a.w + d10*a.vw + d01*bw + d11*b.vw;
+}
+
+bool RobotCommand::trajectoryFinished() const {
+    return trajectoryPoints == 0 || trajectoryTime >= trajectory[trajectoryPoints - 1].t;
+}
 
 // ang2 = position angle
 // ang  = rotation angle
 Robot::Wheel::Wheel(Robot* robot, int _id, dReal ang, dReal ang2, int wheeltexid) {
     id = _id;
     rob = robot;
-    dReal rad = rob->cfg->robotSettings.RobotRadius - rob->cfg->robotSettings.WheelThickness/2.0;
+    dReal rad = rob->settings->RobotRadius - rob->settings->WheelThickness/2.0;
     ang *= M_PI/180.0f;
     ang2 *= M_PI/180.0f;
     dReal x = rob->m_x;
@@ -32,10 +80,10 @@ Robot::Wheel::Wheel(Robot* robot, int _id, dReal ang, dReal ang2, int wheeltexid
     dReal z = rob->m_z;
     dReal centerx = x + rad*cos(ang2);
     dReal centery = y + rad*sin(ang2);
-    dReal centerz = z - rob->cfg->robotSettings.RobotHeight*0.5 + rob->cfg->robotSettings.WheelRadius
-            - rob->cfg->robotSettings.BottomHeight;
-    cyl = new PCylinder(centerx, centery, centerz, rob->cfg->robotSettings.WheelRadius,
-            rob->cfg->robotSettings.WheelThickness, rob->cfg->robotSettings.WheelMass, 0.9, 0.9, 0.9, wheeltexid);
+    dReal centerz = z - rob->settings->RobotHeight*0.5 + rob->settings->WheelRadius
+            - rob->settings->BottomHeight;
+    cyl = new PCylinder(centerx, centery, centerz, rob->settings->WheelRadius,
+            rob->settings->WheelThickness, rob->settings->WheelMass, 0.9, 0.9, 0.9, wheeltexid);
     cyl->setRotation(- sin(ang), cos(ang), 0, M_PI*0.5);
     cyl->setBodyRotation(- sin(ang), cos(ang), 0, M_PI*0.5, true);       //set local rotation matrix
     cyl->setBodyPosition(centerx - x, centery - y, centerz - z, true);       //set local position vector
@@ -54,13 +102,18 @@ Robot::Wheel::Wheel(Robot* robot, int _id, dReal ang, dReal ang2, int wheeltexid
     dJointAttach(motor, rob->chassis->body, cyl->body);
     dJointSetAMotorNumAxes(motor, 1);
     dJointSetAMotorAxis(motor, 0, 1, cos(ang), sin(ang), 0);
-    dJointSetAMotorParam(motor, dParamFMax, rob->cfg->robotSettings.Wheel_Motor_FMax);
+    dJointSetAMotorParam(motor, dParamFMax, rob->settings->Wheel_Motor_FMax);
     speed = 0;
 }
 
 void Robot::Wheel::step() {
+    if (rob->settings->MotorModel == RobotSettings::DCMotor) {
+        //torques are applied by Robot::stepMotors, the velocity motor is disabled
+        dJointSetAMotorParam(motor, dParamFMax, 0);
+        return;
+    }
     dJointSetAMotorParam(motor, dParamVel, speed);
-    dJointSetAMotorParam(motor, dParamFMax, rob->cfg->robotSettings.Wheel_Motor_FMax);
+    dJointSetAMotorParam(motor, dParamFMax, rob->settings->Wheel_Motor_FMax);
 }
 
 Robot::Kicker::Kicker(Robot* robot) {
@@ -69,13 +122,13 @@ Robot::Kicker::Kicker(Robot* robot) {
     dReal x = rob->m_x;
     dReal y = rob->m_y;
     dReal z = rob->m_z;
-    dReal centerx = x + (rob->cfg->robotSettings.RobotCenterFromKicker + rob->cfg->robotSettings.KickerThickness);
+    dReal centerx = x + (rob->settings->RobotCenterFromKicker + rob->settings->KickerThickness);
     dReal centery = y;
-    dReal centerz = z - (rob->cfg->robotSettings.RobotHeight)*0.5f + rob->cfg->robotSettings.WheelRadius
-            - rob->cfg->robotSettings.BottomHeight + rob->cfg->robotSettings.KickerZ;
-    box = new PBox(centerx, centery, centerz, rob->cfg->robotSettings.KickerThickness,
-            rob->cfg->robotSettings.KickerWidth, rob->cfg->robotSettings.KickerHeight,
-            rob->cfg->robotSettings.KickerMass, 0.9, 0.9, 0.9);
+    dReal centerz = z - (rob->settings->RobotHeight)*0.5f + rob->settings->WheelRadius
+            - rob->settings->BottomHeight + rob->settings->KickerZ;
+    box = new PBox(centerx, centery, centerz, rob->settings->KickerThickness,
+            rob->settings->KickerWidth, rob->settings->KickerHeight,
+            rob->settings->KickerMass, 0.9, 0.9, 0.9);
     box->setBodyPosition(centerx - x, centery - y, centerz - z, true);
     box->space = rob->space;
 
@@ -93,7 +146,18 @@ Robot::Kicker::Kicker(Robot* robot) {
 
     rolling = 0;
     kicking = false;
+    touchingBall = false;
     angle = 0;
+
+    chargeState = READY;
+    energy = rob->settings->KickerCapacitorEnergy;
+    dischargeTimer = 0;
+    pendingSpeedX = pendingSpeedZ = 0;
+
+    holding = false;
+    holdBlocked = false;
+    holdMode = ROLLER_TORQUE;
+    holdJoint = 0;
 }
 
 void Robot::Kicker::step() {
@@ -104,7 +168,7 @@ void Robot::Kicker::step() {
     }
     else if (rolling != 0) {
         box->setColor(1, 0.7, 0);
-        if (isTouchingBall()) {
+        if (isTouchingBall() && !holding) {
             dReal fx, fy, fz;
             rob->chassis->getBodyDirection(fx, fy, fz);
             fz = sqrt(fx*fx + fy*fy);
@@ -122,33 +186,21 @@ void Robot::Kicker::step() {
             rob->chassis->getBodyDirection(vx, vy, vz);
             rob->getBall()->getBodyPosition(bx, by, bz);
             box->getBodyPosition(kx, ky, kz);
-            dReal yy = - ((- (kx - bx)*vy + (ky - by)*vx))/rob->cfg->robotSettings.KickerWidth;
+            dReal yy = - ((- (kx - bx)*vy + (ky - by)*vx))/rob->settings->KickerWidth;
             //dReal dir = 1;
             //if (yy>0) dir = -1.0f;//never read
-            dBodySetAngularVel(rob->getBall()->body, fy*rob->cfg->robotSettings.RollerTorqueFactor*1400,
-                    - fx*rob->cfg->robotSettings.RollerTorqueFactor*1400, 0);
+            dBodySetAngularVel(rob->getBall()->body, fy*rob->settings->RollerTorqueFactor*1400,
+                    - fx*rob->settings->RollerTorqueFactor*1400, 0);
             //dBodyAddTorque(rob->getBall()->body,fy*rob->cfg->ROLLERTORQUEFACTOR(),-fx*rob->cfg->ROLLERTORQUEFACTOR(),0);
-            dBodyAddTorque(rob->getBall()->body, yy*fx*rob->cfg->robotSettings.RollerPerpendicularTorqueFactor,
-                    yy*fy*rob->cfg->robotSettings.RollerPerpendicularTorqueFactor, 0);
+            dBodyAddTorque(rob->getBall()->body, yy*fx*rob->settings->RollerPerpendicularTorqueFactor,
+                    yy*fy*rob->settings->RollerPerpendicularTorqueFactor, 0);
         }
     }
     else box->setColor(0.9, 0.9, 0.9);
 }
 
 bool Robot::Kicker::isTouchingBall() {
-    dReal vx, vy, vz;
-    dReal bx, by, bz;
-    dReal kx, ky, kz;
-    rob->chassis->getBodyDirection(vx, vy, vz);
-    rob->getBall()->getBodyPosition(bx, by, bz);
-    box->getBodyPosition(kx, ky, kz);
-    kx += vx*rob->cfg->robotSettings.KickerThickness*0.5f;
-    ky += vy*rob->cfg->robotSettings.KickerThickness*0.5f;
-    dReal xx = fabs((kx - bx)*vx + (ky - by)*vy);
-    dReal yy = fabs(- (kx - bx)*vy + (ky - by)*vx);
-    dReal zz = fabs(kz - bz);
-    return ((xx < rob->cfg->robotSettings.KickerThickness*2.0f + rob->cfg->BallRadius())
-            && (yy < rob->cfg->robotSettings.KickerWidth*0.5f) && (zz < rob->cfg->robotSettings.KickerHeight*0.5f));
+    return touchingBall;
 }
 
 void Robot::Kicker::setRoller(int roller) {
@@ -173,7 +225,112 @@ void Robot::Kicker::rotateAbsolute(dReal a) {
     angle = a;
 }
 
+// Advances the capacitor once per physics substep: a fired kick releases the ball when its discharge time is
+// over, after which the capacitor charges linearly back to full in KickerChargeTime
+void Robot::Kicker::stepCharge(dReal dt) {
+    const RobotSettings &settings = *rob->settings;
+    if (settings.KickerChargeTime <= 0) return;
+    if (chargeState == DISCHARGING) {
+        dischargeTimer -= dt;
+        if (dischargeTimer > 0) return;
+        // the requested speed is scaled down when the capacitor can not deliver it, the pulse is spent even
+        // when the ball has left the kicker in the meantime
+        dReal ballEnergy = 0.5*rob->cfg->BallMass()*(pendingSpeedX*pendingSpeedX + pendingSpeedZ*pendingSpeedZ);
+        dReal available = energy*settings.KickerEfficiency;
+        dReal scale = 1;
+        if (ballEnergy > available) scale = sqrt(available/ballEnergy);
+        release(pendingSpeedX*scale, pendingSpeedZ*scale);
+        energy = std::max(0.0, energy - ballEnergy*scale*scale/settings.KickerEfficiency);
+        chargeState = CHARGING;
+    }
+    else if (chargeState == CHARGING) {
+        energy += settings.KickerCapacitorEnergy*dt/settings.KickerChargeTime;
+        if (energy >= settings.KickerCapacitorEnergy) {
+            energy = settings.KickerCapacitorEnergy;
+            chargeState = READY;
+        }
+    }
+}
+
+bool Robot::Kicker::isReady() {
+    return rob->settings->KickerChargeTime <= 0 || chargeState == READY;
+}
+
 void Robot::Kicker::kick(dReal kickspeedx, dReal kickspeedz) {
+    if (rob->settings->KickerChargeTime > 0) {
+        // kicks are ignored until the capacitor is charged, like the robot firmware does
+        if (chargeState != READY) return;
+        chargeState = DISCHARGING;
+        dischargeTimer = (kickspeedz > 0) ? rob->settings->KickerChipDischargeTime
+                                          : rob->settings->KickerFlatDischargeTime;
+        pendingSpeedX = kickspeedx;
+        pendingSpeedZ = kickspeedz;
+    }
+    else release(kickspeedx, kickspeedz);
+    kicking = true;
+    kickstate = 10;
+}
+
+void Robot::Kicker::grab(int mode) {
+    dReal bx, by, bz;
+    rob->getBall()->getBodyPosition(bx, by, bz);
+    if (mode == SOFT_JOINT) {
+        holdJoint = dJointCreateBall(rob->w->world, 0);
+        dJointAttach(holdJoint, box->body, rob->getBall()->body);
+        dJointSetBallAnchor(holdJoint, bx, by, bz);
+        dJointSetBallParam(holdJoint, dParamERP, 0.2);
+        dJointSetBallParam(holdJoint, dParamCFM, 0.001);
+        memset(&holdFeedback, 0, sizeof(holdFeedback));
+        dJointSetFeedback(holdJoint, &holdFeedback);
+    }
+    else dBodyGetPosRelPoint(box->body, bx, by, bz, holdOffset);
+    holdMode = mode;
+    holding = true;
+}
+
+// Keeps the held ball on the kicker for one substep, returns false when it was dropped
+bool Robot::Kicker::hold(int mode, dReal dt) {
+    if (mode != holdMode || rolling == 0 || !rob->on) {
+        drop();
+        return false;
+    }
+    dReal dx, dy, dz;
+    rob->chassis->getBodyDirection(dx, dy, dz);
+    dReal l = sqrt(dx*dx + dy*dy);
+    dReal lx = - dy/l, ly = dx/l;
+    dReal force;
+    if (holdMode == SOFT_JOINT) {
+        force = holdFeedback.f2[0]*lx + holdFeedback.f2[1]*ly;
+    }
+    else {
+        // the force needed to move the ball with the kicker instead of where the last substep left it
+        dVector3 pos, vel;
+        dBodyGetRelPointPos(box->body, holdOffset[0], holdOffset[1], holdOffset[2], pos);
+        dBodyGetRelPointVel(box->body, holdOffset[0], holdOffset[1], holdOffset[2], vel);
+        const dReal* v = dBodyGetLinearVel(rob->getBall()->body);
+        force = rob->cfg->BallMass()*((vel[0] - v[0])*lx + (vel[1] - v[1])*ly)/dt;
+        dBodySetPosition(rob->getBall()->body, pos[0], pos[1], pos[2]);
+        dBodySetLinearVel(rob->getBall()->body, vel[0], vel[1], vel[2]);
+    }
+    if (fabs(force) > rob->cfg->DribbleReleaseForce()) {
+        drop();
+        holdBlocked = true;
+        return false;
+    }
+    return true;
+}
+
+void Robot::Kicker::drop() {
+    if (!holding) return;
+    if (holdJoint != 0) {
+        dJointDestroy(holdJoint);
+        holdJoint = 0;
+    }
+    holding = false;
+}
+
+void Robot::Kicker::release(dReal kickspeedx, dReal kickspeedz) {
+    drop();
     dReal dx, dy, dz;
     dReal vx, vy, vz;
     rob->chassis->getBodyDirection(dx, dy, dz);
@@ -193,18 +350,16 @@ void Robot::Kicker::kick(dReal kickspeedx, dReal kickspeedz) {
         vy = dyy*kickspeedx/dlen;
         vz = zf;
         const dReal* vball = dBodyGetLinearVel(rob->getBall()->body);
-        dReal vn = - (vball[0]*dxx + vball[1]*dyy)*rob->cfg->robotSettings.KickerDampFactor;
+        dReal vn = - (vball[0]*dxx + vball[1]*dyy)*rob->settings->KickerDampFactor;
         dReal vt = - (vball[0]*dyy - vball[1]*dxx);
         vx += vn*dxx - vt*dyy;
         vy += vn*dyy + vt*dxx;
         dBodySetLinearVel(rob->getBall()->body, vx, vy, vz);
     }
-    kicking = true;
-    kickstate = 10;
 }
 
-Robot::Robot(PWorld* world, PBall* ball, ConfigWidget* _cfg, dReal x, dReal y, dReal z, dReal r, dReal g, dReal b,
-        int rob_id, int wheeltexid, int dir) {
+Robot::Robot(PWorld* world, PBall* ball, ConfigWidget* _cfg, const RobotSettings* _settings, dReal x, dReal y, dReal z,
+        dReal r, dReal g, dReal b, int rob_id, int wheeltexid, int dir) {
     m_r = r;
     m_g = g;
     m_b = b;
@@ -215,18 +370,21 @@ Robot::Robot(PWorld* world, PBall* ball, ConfigWidget* _cfg, dReal x, dReal y, d
     m_ball = ball;
     m_dir = dir;
     cfg = _cfg;
+    settings = _settings;
     m_rob_id = rob_id;
     prevYaw = 0;
+    lastMode = RobotCommand::NONE;
     TH_switch = 0;
     prevAngleErr = 0;
+    batteryCurrent = 0;
     space = w->space;
 
-    chassis = new PCylinder(x, y, z, cfg->robotSettings.RobotRadius, cfg->robotSettings.RobotHeight,
-            cfg->robotSettings.BodyMass*0.99f, r, g, b, rob_id, true);
+    chassis = new PCylinder(x, y, z, settings->RobotRadius, settings->RobotHeight,
+            settings->BodyMass*0.99f, r, g, b, rob_id, true);
     chassis->space = space;
     w->addObject(chassis);
 
-    dummy = new PBall(x, y, z, cfg->robotSettings.RobotCenterFromKicker, cfg->robotSettings.BodyMass*0.01f, 0, 0, 0);
+    dummy = new PBall(x, y, z, settings->RobotCenterFromKicker, settings->BodyMass*0.01f, 0, 0, 0);
     dummy->setVisibility(false);
     dummy->space = space;
     w->addObject(dummy);
@@ -236,10 +394,17 @@ Robot::Robot(PWorld* world, PBall* ball, ConfigWidget* _cfg, dReal x, dReal y, d
 
     kicker = new Kicker(this);
 
-    wheels[0] = new Wheel(this, 0, cfg->robotSettings.Wheel1Angle, cfg->robotSettings.Wheel1Angle, wheeltexid);
-    wheels[1] = new Wheel(this, 1, cfg->robotSettings.Wheel2Angle, cfg->robotSettings.Wheel2Angle, wheeltexid);
-    wheels[2] = new Wheel(this, 2, cfg->robotSettings.Wheel3Angle, cfg->robotSettings.Wheel3Angle, wheeltexid);
-    wheels[3] = new Wheel(this, 3, cfg->robotSettings.Wheel4Angle, cfg->robotSettings.Wheel4Angle, wheeltexid);
+    wheels[0] = new Wheel(this, 0, settings->Wheel1Angle, settings->Wheel1Angle, wheeltexid);
+    wheels[1] = new Wheel(this, 1, settings->Wheel2Angle, settings->Wheel2Angle, wheeltexid);
+    wheels[2] = new Wheel(this, 2, settings->Wheel3Angle, settings->Wheel3Angle, wheeltexid);
+    wheels[3] = new Wheel(this, 3, settings->Wheel4Angle, settings->Wheel4Angle, wheeltexid);
+
+    const dReal motorAlpha[4] = {settings->Wheel1Angle, settings->Wheel2Angle,
+                                 settings->Wheel3Angle, settings->Wheel4Angle};
+    for (int i = 0; i < 4; i ++) {
+        wheelSin[i] = sin(motorAlpha[i]*M_PI/180.0);
+        wheelCos[i] = cos(motorAlpha[i]*M_PI/180.0);
+    }
     firsttime = true;
     on = true;
 }
@@ -312,7 +477,7 @@ void Robot::drawLabel() {
     normalizeVector(rx, ry, rz);
     dReal zz = fx*ax + fy*ay + fz*az;
     dReal zfact = zz/fr_n;
-    pos[2] += cfg->robotSettings.RobotHeight*0.5f + cfg->robotSettings.BottomHeight + cfg->robotSettings.WheelRadius
+    pos[2] += settings->RobotHeight*0.5f + settings->BottomHeight + settings->WheelRadius
             + txtHeight*zfact;
     dMatrix3 rot;
     dRFromAxisAndAngle(rot, 0, 0, 0, 0);
@@ -365,6 +530,9 @@ void Robot::resetRobot() {
     setXY(x, y);
     if (m_dir == - 1) setDir(180);
     else setDir(0);
+    prevYaw = constrainAngle(getDir()*M_PI/180.0);
+    prevAngleErr = 0;
+    lastMode = RobotCommand::NONE;
 }
 
 void Robot::getXY(dReal &x, dReal &y) {
@@ -384,8 +552,9 @@ dReal Robot::getDir() {
 }
 
 void Robot::setXY(dReal x, dReal y) {
+    kicker->drop();
     dReal xx, yy, zz, kx, ky, kz;
-    dReal height = ROBOT_START_Z(cfg);
+    dReal height = ROBOT_START_Z(settings);
     chassis->getBodyPosition(xx, yy, zz);
     chassis->setBodyPosition(x, y, height);
     dummy->setBodyPosition(x, y, height);
@@ -431,23 +600,13 @@ void Robot::setSpeed(int i, dReal s) {
 }
 
 void Robot::setSpeed(dReal vx, dReal vy, dReal vw) {
-    // Calculate Motor Speeds
-    dReal _DEG2RAD = M_PI/180.0;
-    dReal motorAlpha[4] = {cfg->robotSettings.Wheel1Angle*_DEG2RAD, cfg->robotSettings.Wheel2Angle*_DEG2RAD,
-                           cfg->robotSettings.Wheel3Angle*_DEG2RAD, cfg->robotSettings.Wheel4Angle*_DEG2RAD};
-
-    dReal kP = 1.0;
-    dReal kD = 0.2;
-    for (unsigned int i = 0; i < 4; i ++) {
-        dReal dw = (1.0/cfg->robotSettings.WheelRadius)*(
-                   (cfg->robotSettings.RobotRadius*vw) -
-                   (vx*sin(motorAlpha[i])) +
-                   (vy*cos(motorAlpha[i])));
-
-        double P = kP*dw;
-        double D = - kD*(dw - getSpeed(i))/cfg->DesiredFPS();
-        setSpeed(i, P + D);
-    }
+    RobotCommand command;
+    command.mode = RobotCommand::VELOCITY;
+    command.vx = vx;
+    command.vy = vy;
+    command.vw = vw;
+    Robot* self = this;
+    applyCommands(&self, &command, 1, 1.0/cfg->DesiredFPS());
 }
 
 dReal Robot::getSpeed(int i) {
@@ -462,57 +621,260 @@ void Robot::incSpeed(int i, dReal v) {
 
 //Implements our angle control cycle
 void Robot::setAngle(dReal vx, dReal vy, dReal vw) {
+    RobotCommand command;
+    command.mode = RobotCommand::ANGLE;
+    command.vx = vx;
+    command.vy = vy;
+    command.vw = vw;
+    Robot* self = this;
+    applyCommands(&self, &command, 1, 1.0/cfg->DesiredFPS());
+}
+
+// Converts the command of every robot to wheel speeds, robot by robot. dt is the time since the previous call,
+// used by the derivative terms.
+void Robot::applyCommands(Robot** robots, const RobotCommand* commands, int count, dReal dt) {
+    for (int i = 0; i < count; i ++) {
+        Robot* rob = robots[i];
+        if (!rob->on) {
+            rob->lastMode = RobotCommand::NONE;
+            continue;
+        }
+        rob->applyCommand(commands[i], dt);
+    }
+}
+
+void Robot::applyCommand(const RobotCommand &command, dReal dt) {
+    const dReal kP = 1.0;
+    const dReal kD = 0.2;
+    const dReal kAngP = 6.0;
+    const dReal kAngD = 0.6;
+    const dReal kTrajP = 3.0;
+    const dReal kTrajAngP = 4.0;
+
+    //The yaw and the angle error of a previous angle command are stale once another mode ran
+    const bool entering = command.mode != lastMode;
+    lastMode = command.mode;
+    if (command.mode == RobotCommand::WHEELS) {
+        for (int j = 0; j < 4; j ++) setSpeed(j, command.wheel[j]);
+        return;
+    }
+    if (command.mode == RobotCommand::PWM || command.mode == RobotCommand::PWM_ANGLE) {
+        dReal Fw = command.vw;
+        if (command.mode == RobotCommand::PWM_ANGLE) {
+            double robotAngle = constrainAngle(getDir()*M_PI/180.0);
+            if (entering) {
+                prevYaw = robotAngle;
+                prevAngleErr = constrainAngle(command.vw - robotAngle);
+            }
+            Fw = angleControl(command.vw, robotAngle, dt);
+        }
+        setPWM(command.vx, command.vy, Fw);
+        return;
+    }
+    if (command.mode != RobotCommand::VELOCITY && command.mode != RobotCommand::ANGLE
+            && command.mode != RobotCommand::TRAJECTORY) return;
+
+    dReal vx = command.vx, vy = command.vy, vw = command.vw;
+    if (command.mode == RobotCommand::TRAJECTORY) {
+        //Trajectory tracking: feed forward of the reference velocity plus P control on the pose error,
+        //in the field frame like ANGLE commands
+        dReal pose[3], vel[3], x, y;
+        command.sampleTrajectory(command.trajectoryTime, pose, vel);
+        getXY(x, y);
+        double robotAngle = getDir()*M_PI/180.0;
+        dReal fx = vel[0] + kTrajP*(pose[0] - x);
+        dReal fy = vel[1] + kTrajP*(pose[1] - y);
+        vx = cos(robotAngle)*fx + sin(robotAngle)*fy;
+        vy = cos(robotAngle)*fy - sin(robotAngle)*fx;
+        vw = vel[2] + kTrajAngP*constrainAngle(pose[2] - robotAngle);
+    }
+    else if (command.mode == RobotCommand::ANGLE) {
+        //Angle PD, and rotation of the field frame velocity into the robot frame
+        double robotAngle = constrainAngle(getDir()*M_PI/180.0);
+        if (entering) prevYaw = robotAngle;
+        double deltaAngle = constrainAngle(command.vw - robotAngle);
+        double angularVel = constrainAngle(robotAngle - prevYaw)/dt;
+        prevYaw = robotAngle;
+        vx = cos(robotAngle)*command.vx + sin(robotAngle)*command.vy;
+        vy = cos(robotAngle)*command.vy - sin(robotAngle)*command.vx;
+        vw = kAngP*deltaAngle - kAngD*angularVel;
+    }
+
+    //Calculate motor speeds. The damping term scales with the controller period, so it fades at high
+    //controller rates: at 1 kHz it is about a twentieth of what it was at 60 Hz and kP alone sets the response
+    for (int j = 0; j < 4; j ++) {
+        dReal dw = (settings->RobotRadius*vw - vx*wheelSin[j] + vy*wheelCos[j])/settings->WheelRadius;
+        wheels[j]->speed = kP*dw - kD*(dw - wheels[j]->speed)*dt;
+    }
+}
+
+// DC motor model of all wheels with the "dc" motor model, evaluated before every physics substep. The motor
+// driver sets a voltage from the speed setpoint (back-EMF feed forward plus a proportional term) limited by the
+// battery voltage, which sags with the current drawn in the previous substep. The current follows from the
+// back-EMF of the wheel speed, is clamped to the current limit and gives the torque applied to the wheel.
+void Robot::stepMotors(Robot** robots, int count) {
+    const int WHEELS = 4*COMMAND_BATCH_SIZE;
+    for (int first = 0; first < count; first += COMMAND_BATCH_SIZE) {
+        const int n = std::min(COMMAND_BATCH_SIZE, count - first);
+        Robot* batch[COMMAND_BATCH_SIZE];
+        dReal target[WHEELS], omega[WHEELS], busVoltage[WHEELS], emf[WHEELS], gain[WHEELS];
+        dReal invResistance[WHEELS], currentLimit[WHEELS], torque[WHEELS], power[WHEELS];
+        int m = 0;
+
+        for (int i = 0; i < n; i ++) {
+            Robot* rob = robots[first + i];
+            const RobotSettings &settings = *rob->settings;
+            if (settings.MotorModel != RobotSettings::DCMotor) continue;
+            batch[m] = rob;
+            dReal voltage = std::max(0.0, settings.MotorVoltage - settings.BatteryResistance*rob->batteryCurrent);
+            for (int j = 0; j < 4; j ++) {
+                int w = m*4 + j;
+                target[w] = rob->wheels[j]->speed;
+                omega[w] = dJointGetHingeAngleRate(rob->wheels[j]->joint);
+                busVoltage[w] = voltage;
+                emf[w] = settings.MotorTorqueConstant*settings.MotorGearRatio;
+                gain[w] = settings.MotorSpeedGain;
+                invResistance[w] = 1.0/settings.MotorResistance;
+                currentLimit[w] = settings.MotorCurrentLimit;
+            }
+            m ++;
+        }
+
+        for (int w = 0; w < m*4; w ++) {
+            dReal voltage = emf[w]*target[w] + gain[w]*(target[w] - omega[w]);
+            voltage = std::min(busVoltage[w], std::max(- busVoltage[w], voltage));
+            dReal current = (voltage - emf[w]*omega[w])*invResistance[w];
+            current = std::min(currentLimit[w], std::max(- currentLimit[w], current));
+            torque[w] = emf[w]*current;
+            power[w] = fabs(voltage*current);
+        }
+
+        for (int k = 0; k < m; k ++) {
+            dReal totalPower = 0;
+            for (int j = 0; j < 4; j ++) {
+                dJointAddAMotorTorques(batch[k]->wheels[j]->motor, torque[k*4 + j], 0, 0);
+                totalPower += power[k*4 + j];
+            }
+            batch[k]->batteryCurrent = totalPower/std::max(busVoltage[k*4], 1.0);
+        }
+    }
+}
+
+// Kicker-ball proximity of all robots, evaluated once per physics substep against the shared ball and cached
+// on the kickers for kicking, dribbling and the status reply
+void Robot::updateBallContacts(Robot** robots, int count) {
+    if (count <= 0) return;
+    dReal bx, by, bz;
+    robots[0]->getBall()->getBodyPosition(bx, by, bz);
+    for (int first = 0; first < count; first += COMMAND_BATCH_SIZE) {
+        const int n = std::min(COMMAND_BATCH_SIZE, count - first);
+        dReal dx[COMMAND_BATCH_SIZE], dy[COMMAND_BATCH_SIZE], dz[COMMAND_BATCH_SIZE];
+        dReal vx[COMMAND_BATCH_SIZE], vy[COMMAND_BATCH_SIZE];
+        dReal maxX[COMMAND_BATCH_SIZE], maxY[COMMAND_BATCH_SIZE], maxZ[COMMAND_BATCH_SIZE];
+        bool touching[COMMAND_BATCH_SIZE];
+
+        for (int i = 0; i < n; i ++) {
+            Robot* rob = robots[first + i];
+            const RobotSettings &settings = *rob->settings;
+            dReal vz, kx, ky, kz;
+            rob->chassis->getBodyDirection(vx[i], vy[i], vz);
+            rob->kicker->box->getBodyPosition(kx, ky, kz);
+            dx[i] = kx + vx[i]*settings.KickerThickness*0.5f - bx;
+            dy[i] = ky + vy[i]*settings.KickerThickness*0.5f - by;
+            dz[i] = kz - bz;
+            maxX[i] = settings.KickerThickness*2.0f + rob->cfg->BallRadius();
+            maxY[i] = settings.KickerWidth*0.5f;
+            maxZ[i] = settings.KickerHeight*0.5f;
+        }
+
+        for (int i = 0; i < n; i ++) {
+            dReal xx = fabs(dx[i]*vx[i] + dy[i]*vy[i]);
+            dReal yy = fabs(- dx[i]*vy[i] + dy[i]*vx[i]);
+            touching[i] = (xx < maxX[i]) && (yy < maxY[i]) && (fabs(dz[i]) < maxZ[i]);
+        }
+
+        for (int i = 0; i < n; i ++) robots[first + i]->kicker->touchingBall = touching[i];
+    }
+}
 
-//Get difference angle towards targetAngle
-    double robotAngle = constrainAngle(getDir()*M_PI/180.0);
-    double deltaAngle = constrainAngle(vw - robotAngle);
-    if (deltaAngle < - M_PI)
-        deltaAngle += 2*M_PI;
-    else if (deltaAngle > M_PI)
-        deltaAngle -= 2*M_PI;
-
-//Get angular velocity
-    double angularVel = robotAngle - prevYaw;
-    prevYaw = robotAngle;
-
-//Transform vx, vy relative to robot to newvx, newvy which are relative to the world
-    double velocityAngle = atan2(vy, vx);
-    velocityAngle -= robotAngle;
-    double vLength = sqrt(vx*vx + vy*vy);
-    double newvy = sin(velocityAngle)*vLength;
-    double newvx = cos(velocityAngle)*vLength;
-
-//PID control for the angle
-    double tps = cfg->DesiredFPS();
-    double kAngP = 6.0;
-    double kAngD = 0.6;
-
-    double pidAngP = kAngP*deltaAngle;
-    double pidAngD = - kAngD*angularVel*tps;
-
-    setSpeed(newvx, newvy, pidAngP + pidAngD);
-}
-
-std::vector<double> Robot::body2Wheels(dReal Fx, dReal Fy, dReal Fw) {
-    float R = 0.0775; //robot radius
-    float r = 0.0275; //wheel radius
-    float cos60 = 0.5;
-    float sin60 = 0.866;
-    float PWM_CUTOFF = 3.0;
-    float T_CUTOFF = (PWM_CUTOFF + 0.1F)*4*R/r;
-    std::vector<double> output;
-    if ((fabs(Fw) < T_CUTOFF) && (fabs(Fw) > T_CUTOFF/2 - 0.1F)) { //only using 2 motors for rotation, output doubled.
-        std::cout << "Using only 2 wheels for rotation" << std::endl;
-        output.push_back((1/sin60*Fx + 1/cos60*Fy + 2/R*Fw)*r/4);
-        output.push_back((1/sin60*Fx - 1/cos60*Fy)*r/4);
-        output.push_back((- 1/sin60*Fx - 1/cos60*Fy + 2/R*Fw)*r/4);
-        output.push_back((- 1/sin60*Fx + 1/cos60*Fy)*r/4);
+// With the "Soft joint" or "Kinematic" dribble mode a robot with a running roller that touches the ball
+// holds it relative to its kicker box, which stays stable at larger physics steps than the roller torque
+// emulation. At most one robot holds the ball, it is dropped on kicks, when the roller stops or when the
+// lateral force on the ball exceeds DribbleReleaseForce.
+void Robot::stepDribblers(Robot** robots, int count, dReal dt) {
+    if (count <= 0) return;
+    int mode = Kicker::ROLLER_TORQUE;
+    std::string dribbleMode = robots[0]->cfg->DribbleMode();
+    if (dribbleMode == "Soft joint") mode = Kicker::SOFT_JOINT;
+    else if (dribbleMode == "Kinematic") mode = Kicker::KINEMATIC;
+
+    bool held = false;
+    for (int i = 0; i < count; i ++) {
+        Kicker* kicker = robots[i]->kicker;
+        if (kicker->holding) {
+            held = kicker->hold(mode, dt);
+            break;
+        }
+    }
+    // a robot may grab again once it let go of the ball, which is checked even while another one holds it
+    bool grabbed = held || mode == Kicker::ROLLER_TORQUE;
+    for (int i = 0; i < count; i ++) {
+        Kicker* kicker = robots[i]->kicker;
+        if (!kicker->touchingBall) kicker->holdBlocked = false;
+        else if (!grabbed && kicker->rolling != 0 && robots[i]->on && !kicker->holdBlocked) {
+            kicker->grab(mode);
+            grabbed = true;
+        }
+    }
+}
+
+MotorTrace::MotorTrace() {
+    head = 0;
+    size = 0;
+}
+
+void MotorTrace::record(int event, const WheelValues &values) {
+    Entry &e = entries[head];
+    e.event = event;
+    e.values = values;
+    head = (head + 1)%MOTOR_TRACE_SIZE;
+    if (size < MOTOR_TRACE_SIZE) size ++;
+}
+
+int MotorTrace::count() const {
+    return size;
+}
+
+const MotorTrace::Entry &MotorTrace::at(int i) const {
+    return entries[(head - size + i + MOTOR_TRACE_SIZE)%MOTOR_TRACE_SIZE];
+}
+
+void MotorTrace::clear() {
+    head = 0;
+    size = 0;
+}
+
+WheelValues Robot::body2Wheels(dReal Fx, dReal Fy, dReal Fw, bool* twoWheels) {
+    const double R = 0.0775; //robot radius
+    const double r = 0.0275; //wheel radius
+    const double cos60 = 0.5;
+    const double sin60 = 0.866;
+    const double PWM_CUTOFF = 3.0;
+    const double T_CUTOFF = (PWM_CUTOFF + 0.1F)*4*R/r;
+    WheelValues output;
+    bool two = (fabs(Fw) < T_CUTOFF) && (fabs(Fw) > T_CUTOFF/2 - 0.1F);
+    if (twoWheels) *twoWheels = two;
+    if (two) { //only using 2 motors for rotation, output doubled.
+        output[0] = (1/sin60*Fx + 1/cos60*Fy + 2/R*Fw)*r/4;
+        output[1] = (1/sin60*Fx - 1/cos60*Fy)*r/4;
+        output[2] = (- 1/sin60*Fx - 1/cos60*Fy + 2/R*Fw)*r/4;
+        output[3] = (- 1/sin60*Fx + 1/cos60*Fy)*r/4;
     }
     else { //NORMAL case
-        output.push_back((1/sin60*Fx + 1/cos60*Fy + 1/R*Fw)*r/4);
-        output.push_back((1/sin60*Fx - 1/cos60*Fy + 1/R*Fw)*r/4);
-        output.push_back((- 1/sin60*Fx - 1/cos60*Fy + 1/R*Fw)*r/4);
-        output.push_back((- 1/sin60*Fx + 1/cos60*Fy + 1/R*Fw)*r/4);
+        output[0] = (1/sin60*Fx + 1/cos60*Fy + 1/R*Fw)*r/4;
+        output[1] = (1/sin60*Fx - 1/cos60*Fy + 1/R*Fw)*r/4;
+        output[2] = (- 1/sin60*Fx - 1/cos60*Fy + 1/R*Fw)*r/4;
+        output[3] = (- 1/sin60*Fx + 1/cos60*Fy + 1/R*Fw)*r/4;
     }
     return output;
 }
@@ -520,7 +882,7 @@ std::vector<double> Robot::body2Wheels(dReal Fx, dReal Fy, dReal Fw) {
 double Robot::scaleLimit(dReal Fx, dReal Fy, dReal Fw, dReal limit) {
 
     double scale;
-    std::vector<double> imOutput = body2Wheels(Fx, Fy, Fw);
+    WheelValues imOutput = body2Wheels(Fx, Fy, Fw);
     double maxEl = fmax(fmax(fabs(imOutput[0]), fabs(imOutput[1])), fmax(fabs(imOutput[2]), fabs(imOutput[3])));
 
     if ((maxEl) > limit) {
@@ -533,7 +895,7 @@ double Robot::scaleLimit(dReal Fx, dReal Fy, dReal Fw, dReal limit) {
     return scale;
 }
 
-std::vector<double> Robot::pwm2Motor(std::vector<double> power) {
+WheelValues Robot::pwm2Motor(WheelValues power) {
     double PWM_CUTOFF = 3.0;
     double PWM_ROUNDUP = 3.1;
     double PWM_MAX = 100;
@@ -556,27 +918,43 @@ std::vector<double> Robot::pwm2Motor(std::vector<double> power) {
             }
         }
     }
-    std::cout << std::endl;
-    std::vector<double> desiredVel;
+    if (cfg->MotorTrace()) motorTrace.record(MotorTrace::PWM_OUTPUT, power);
+    WheelValues desiredVel;
     for (int j = 0; j < 4; ++ j) {
-        desiredVel.push_back(374.0/60.0*power[j]*12/100*(1
-                /0.288)); //power is % of total power given. 374 rpm/V *total Voltage (power*12/100). So current units is in rotation/second
+        desiredVel[j] = 374.0/60.0*power[j]*12/100*(1
+                /0.288); //power is % of total power given. 374 rpm/V *total Voltage (power*12/100). So current units is in rotation/second
     }
     return desiredVel;
 }
+
+// Runs the RoboTeam firmware motor pipeline: body forces to PWM, PWM to wheel speed
+void Robot::setPWM(dReal Fx, dReal Fy, dReal Fw) {
+    const double PWM_MAX = 100;
+    double scale = scaleLimit(Fx, Fy, Fw, PWM_MAX);
+    bool twoWheels;
+    WheelValues power = body2Wheels(Fx*scale, Fy*scale, Fw*scale, &twoWheels);
+    // only here, scaleLimit also goes through body2Wheels
+    if (twoWheels && cfg->MotorTrace()) motorTrace.record(MotorTrace::TWO_WHEEL_ROTATION, power);
+    WheelValues speeds = pwm2Motor(power);
+    for (int i = 0; i < 4; i ++) {
+        speeds[i] *= 2*M_PI; //rotation/second to rad/s
+        setSpeed(i, speeds[i]);
+    }
+    if (cfg->MotorTrace()) motorTrace.record(MotorTrace::WHEEL_SPEED, speeds);
+}
+
 double Robot::constrainAngle(double x) {
     x = fmod(x + M_PI, 2*M_PI);
     if (x < 0)
         x += 2*M_PI;
     return x - M_PI;
 }
-double Robot::angleControl(double angleRef, double yaw) {
+double Robot::angleControl(double angleRef, double yaw, double dt) {
     double R = 0.0775; //robot radius
     double r = 0.0275; //wheel radius
-    double T_DIFF = 1/60.0; // integration for time. No clue how this is actually supposed to work on the robot.
     double angleErr = constrainAngle(angleRef - yaw);
 
-    double dErr = constrainAngle(angleErr - prevAngleErr)/T_DIFF;
+    double dErr = constrainAngle(angleErr - prevAngleErr)/dt;
     prevAngleErr = angleErr;
 
     double output;
@@ -43,21 +43,24 @@ RobotWidget::RobotWidget(QWidget* parent, ConfigWidget* cfg)
 
     vellabel = new QLabel;
     acclabel = new QLabel;
+    cmdagelabel = new QLabel;
     resetBtn = new QPushButton("Reset");
     locateBtn = new QPushButton("Locate");
     onOffBtn = new QPushButton("Turn Off");
     setPoseBtn = new QPushButton("Set Position");
-    layout->addWidget(robotpic,0,0,5,1);
+    layout->addWidget(robotpic,0,0,6,1);
     layout->addWidget(new QLabel("Team"),0,1);
     layout->addWidget(teamCombo,0,2);
     layout->addWidget(new QLabel("Index"),1,1);
     layout->addWidget(robotCombo,1,2);
     layout->addWidget(new QLabel("Velocity"),2,1);
     layout->addWidget(vellabel,2,2);
-    layout->addWidget(resetBtn,3,1);
-    layout->addWidget(locateBtn,3,2);
-    layout->addWidget(onOffBtn,4,1);
-    layout->addWidget(setPoseBtn,4,2);
+    layout->addWidget(new QLabel("Command age"),3,1);
+    layout->addWidget(cmdagelabel,3,2);
+    layout->addWidget(resetBtn,4,1);
+    layout->addWidget(locateBtn,4,2);
+    layout->addWidget(onOffBtn,5,1);
+    layout->addWidget(setPoseBtn,5,2);
     QWidget *widget = new QWidget(this);
     widget->setLayout(layout);
     widget->setSizePolicy(QSizePolicy::Fixed,QSizePolicy::Fixed);
@@ -38,9 +38,6 @@ Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
 #define WHEEL_COUNT 4
 
 SSLWorld* _w;
-dReal randn_notrig(dReal mu=0.0, dReal sigma=1.0);
-dReal randn_trig(dReal mu=0.0, dReal sigma=1.0);
-dReal rand0_1();
 
 dReal fric(dReal f)
 {
@@ -65,9 +62,8 @@ bool wheelCallBack(dGeomID o1,dGeomID o2,PSurface* s, int /*robots_count*/)
         return false;
     }
 
+    //friction coefficients are set per wheel when the surface is created
     s->surface.mode = dContactFDir1 | dContactMu2  | dContactApprox1 | dContactSoftCFM;
-    s->surface.mu = fric(_w->cfg->robotSettings.WheelPerpendicularFriction);
-    s->surface.mu2 = fric(_w->cfg->robotSettings.WheelTangentFriction);
     s->surface.soft_cfm = 0.002;
 
     dVector3 v={0,0,1,1};
@@ -142,6 +138,9 @@ SSLWorld::SSLWorld(QGLWidget* parent,ConfigWidget* _cfg,RobotsFormation *form1,R
     updatedCursor = false;
     framenum = 0;
     last_dt = -1;
+    controlTime = 0;
+    simTime = 0;
+    timeOrigin = QDateTime::currentMSecsSinceEpoch()/1000.0;
     g = new CGraphics(parent);
     g->setSphereQuality(1);
     g->setViewpoint(0,-(cfg->Field_Width()+cfg->Field_Margin()*2.0f)/2.0f,3,90,-45,0);
@@ -222,17 +221,19 @@ SSLWorld::SSLWorld(QGLWidget* parent,ConfigWidget* _cfg,RobotsFormation *form1,R
     const int wheeltexid = 4 * cfg->Robots_Count() + 12 + 1 ; //37 for 6 robots
 
 
-    cfg->robotSettings = cfg->blueSettings;
     for (int k=0;k<cfg->Robots_Count();k++) {
-        float a1 = -form1->x[k];
-        float a2 = form1->y[k];
-        float a3 = ROBOT_START_Z(cfg);
+        robotSettings[k] = cfg->getRobotSettings(0, k);
+        robotSettings[k+cfg->Robots_Count()] = cfg->getRobotSettings(1, k);
+    }
+    for (int k=0;k<cfg->Robots_Count();k++) {
+        const RobotSettings* settings = &robotSettings[k];
         robots[k] = new Robot(p,
                               ball,
                               cfg,
+                              settings,
                               -form1->x[k],
                               form1->y[k],
-                              ROBOT_START_Z(cfg),
+                              ROBOT_START_Z(settings),
                               ROBOT_GRAY,
                               ROBOT_GRAY,
                               ROBOT_GRAY,
@@ -240,9 +241,10 @@ SSLWorld::SSLWorld(QGLWidget* parent,ConfigWidget* _cfg,RobotsFormation *form1,R
                               wheeltexid,
                               1);
     }
-    cfg->robotSettings = cfg->yellowSettings;
-    for (int k=0;k<cfg->Robots_Count();k++)
-        robots[k+cfg->Robots_Count()] = new Robot(p,ball,cfg,form2->x[k],form2->y[k],ROBOT_START_Z(cfg),ROBOT_GRAY,ROBOT_GRAY,ROBOT_GRAY,k+cfg->Robots_Count()+1,wheeltexid,-1);//XXX
+    for (int k=0;k<cfg->Robots_Count();k++) {
+        const RobotSettings* settings = &robotSettings[k+cfg->Robots_Count()];
+        robots[k+cfg->Robots_Count()] = new Robot(p,ball,cfg,settings,form2->x[k],form2->y[k],ROBOT_START_Z(settings),ROBOT_GRAY,ROBOT_GRAY,ROBOT_GRAY,k+cfg->Robots_Count()+1,wheeltexid,-1);//XXX
+    }
 
     p->initAllObjects();
 
@@ -269,7 +271,6 @@ SSLWorld::SSLWorld(QGLWidget* parent,ConfigWidget* _cfg,RobotsFormation *form1,R
 
     PSurface ballwithkicker;
     ballwithkicker.surface.mode = dContactApprox1;
-    ballwithkicker.surface.mu = fric(cfg->robotSettings.Kicker_Friction);
     ballwithkicker.surface.slip1 = 5;
 
     for (int i = 0; i < WALL_COUNT; i++)
@@ -282,12 +283,16 @@ SSLWorld::SSLWorld(QGLWidget* parent,ConfigWidget* _cfg,RobotsFormation *form1,R
             p->createSurface(robots[k]->chassis,walls[j]);
         p->createSurface(robots[k]->dummy,ball);
         //p->createSurface(robots[k]->chassis,ball);
-        p->createSurface(robots[k]->kicker->box,ball)->surface = ballwithkicker.surface;
+        PSurface* k_b = p->createSurface(robots[k]->kicker->box,ball);
+        k_b->surface = ballwithkicker.surface;
+        k_b->surface.mu = fric(robots[k]->settings->Kicker_Friction);
         for (int j = 0; j < WHEEL_COUNT; j++)
         {
             p->createSurface(robots[k]->wheels[j]->cyl,ball);
             PSurface* w_g = p->createSurface(robots[k]->wheels[j]->cyl,ground);
             w_g->surface=wheelswithground.surface;
+            w_g->surface.mu = fric(robots[k]->settings->WheelPerpendicularFriction);
+            w_g->surface.mu2 = fric(robots[k]->settings->WheelTangentFriction);
             w_g->usefdir1=true;
             w_g->callback=wheelCallBack;
         }
@@ -301,6 +306,14 @@ SSLWorld::SSLWorld(QGLWidget* parent,ConfigWidget* _cfg,RobotsFormation *form1,R
         }
     }
     sendGeomCount = 0;
+    layoutCameras = -1;
+    scheduleRate = -1;
+    visionSender = new VisionSender();
+    groundTruthServer = NULL;
+    localCommandSocket = NULL;
+    nextGroundTruth = 0;
+    layoutOverlap = 0;
+    layoutHeight = 0;
 
     in_buffer = new char [65536];
 }
@@ -313,6 +326,9 @@ int SSLWorld::robotIndex(int robot,int team)
 
 SSLWorld::~SSLWorld()
 {
+    visionSender->requestInterruption();
+    visionSender->wait();
+    delete visionSender;
     delete g;
     delete p;
 }
@@ -393,9 +409,22 @@ void SSLWorld::step(dReal dt)
 
     if (customDT > 0)
         dt = customDT;
+    // the default step is the configured physics step, the simulated clock and everything stepped with dt follow it
+    if (dt < 0)
+        dt = cfg->DeltaTime();
     const auto ratio = m_parent->devicePixelRatio();
     g->initScene(m_parent->width()*ratio,m_parent->height()*ratio,0,0.7,1);
-    for (int kk=0;kk<5;kk++)
+    if (dt==0) dt=last_dt;
+    else last_dt = dt;
+    // All timestamps come from the simulated time. Anchored, the clock catches up with wall time between
+    // frames when the physics lags behind, but never runs backwards
+    if (cfg->ClockAnchoredToWall())
+    {
+        dReal origin = QDateTime::currentMSecsSinceEpoch()/1000.0 - simTime;
+        if (origin > timeOrigin) timeOrigin = origin;
+    }
+    int substeps = 5;
+    for (int kk=0;kk<substeps;kk++)
     {
         const dReal* ballvel = dBodyGetLinearVel(ball->body);
         dReal ballspeed = ballvel[0]*ballvel[0] + ballvel[1]*ballvel[1] + ballvel[2]*ballvel[2];
@@ -421,11 +450,17 @@ void SSLWorld::step(dReal dt)
         balltz = 0;
         dBodyAddTorque(ball->body, balltx, ballty, balltz);
         dBodyAddForce(ball->body,ballfx,ballfy,ballfz);
-        if (dt==0) dt=last_dt;
-        else last_dt = dt;
+
+        Robot::stepMotors(robots, cfg->Robots_Count()*2);
 
         selected = -1;
-        p->step(dt*0.2);
+        p->step(dt/substeps);
+        simTime += dt/substeps;
+        if (cfg->CameraRate() > 0) captureCameras(dt/substeps);
+        Robot::updateBallContacts(robots, cfg->Robots_Count()*2);
+        for (int k=0;k<cfg->Robots_Count()*2;k++) robots[k]->kicker->stepCharge(dt/substeps);
+        Robot::stepDribblers(robots, cfg->Robots_Count()*2, dt/substeps);
+        stepController(dt/substeps);
     }
 
 
@@ -491,10 +526,51 @@ void SSLWorld::step(dReal dt)
 
 
     sendVisionBuffer();
+    if (cfg->GroundTruth()) sendGroundTruth();
     framenum ++;
 }
 
 
+// Emulates the on-board robot controllers: the latest command of every robot is held as a setpoint and
+// converted to wheel speeds at ControllerRate, independent of the rate at which commands arrive. The controller
+// keeps its own clock and does not change the physics substeps, it runs at most once per substep, so rates
+// above the substep rate run it every substep with the elapsed time as its period.
+void SSLWorld::stepController(dReal dt)
+{
+    for (int i = 0; i < cfg->Robots_Count()*2; i++)
+    {
+        commands[i].age += dt;
+        commands[i].trajectoryTime += dt;
+    }
+    controlTime += dt;
+    if (cfg->ControllerRate() > 0 && controlTime < 1.0/cfg->ControllerRate() - 1e-6) return;
+    if (cfg->CommandTimeout() > 0)
+    {
+        // watchdog: a robot that stopped receiving commands ramps its wheels down and stops the dribbler
+        dReal ramp = cfg->CommandRampRate()*controlTime;
+        for (int i = 0; i < cfg->Robots_Count()*2; i++)
+        {
+            RobotCommand &command = commands[i];
+            if (command.mode == RobotCommand::NONE || command.age < cfg->CommandTimeout()) continue;
+            if (command.mode == RobotCommand::TRAJECTORY && !command.trajectoryFinished()) continue;
+            if (!command.stale)
+            {
+                command.stale = true;
+                command.mode = RobotCommand::WHEELS;
+                for (int j = 0; j < 4; j++) command.wheel[j] = robots[i]->getSpeed(j);
+                robots[i]->kicker->setRoller(0);
+            }
+            for (int j = 0; j < 4; j++)
+            {
+                if (command.wheel[j] > 0) command.wheel[j] = qMax(0.0, command.wheel[j] - ramp);
+                else command.wheel[j] = qMin(0.0, command.wheel[j] + ramp);
+            }
+        }
+    }
+    Robot::applyCommands(robots, commands, cfg->Robots_Count()*2, controlTime);
+    controlTime = 0;
+}
+
 void SSLWorld::recvActions()
 {
     QHostAddress sender;
@@ -506,125 +582,203 @@ void SSLWorld::recvActions()
         if (size > 0)
         {
             packet.ParseFromArray(in_buffer, size);
-            int team=0;
-            if (packet.has_commands())
+            processPacket(packet, sender, QString());
+        }
+    }
+}
+
+// Commands over the unix socket, the status goes back to the socket of the sender if it is bound
+void SSLWorld::recvLocalActions()
+{
+    QString sender;
+    grSim_Packet packet;
+    while (localCommandSocket->hasPendingDatagrams())
+    {
+        int size = localCommandSocket->readDatagram(in_buffer, 65536, &sender);
+        if (size > 0)
+        {
+            packet.ParseFromArray(in_buffer, size);
+            processPacket(packet, QHostAddress(QHostAddress::LocalHost), sender);
+        }
+    }
+}
+
+void SSLWorld::processPacket(const grSim_Packet& packet, const QHostAddress& sender, const QString& senderPath)
+{
+    int team=0;
+    if (packet.has_commands())
+    {
+        if (packet.commands().has_isteamyellow())
+        {
+            if (packet.commands().isteamyellow()) team=1;
+        }
+        for (int i=0;i<packet.commands().robot_commands_size();i++)
+        {
+            if (packet.commands().robot_commands(i).id() < 0 || packet.commands().robot_commands(i).id() >15) continue;
+            int k = packet.commands().robot_commands(i).id();
+            int id = robotIndex(k, team);
+            if ((id < 0) || (id >= cfg->Robots_Count()*2)) continue;
+            RobotCommand &command = commands[id];
+            dReal lastAge = command.age;
+            bool wasStale = command.stale;
+            command.age = 0;
+            command.stale = false;
+            bool wheels = false;
+            if (packet.commands().robot_commands(i).has_wheelsspeed())
             {
-                if (packet.commands().has_isteamyellow())
+                if (packet.commands().robot_commands(i).wheelsspeed())
                 {
-                    if (packet.commands().isteamyellow()) team=1;
-                }
-                for (int i=0;i<packet.commands().robot_commands_size();i++)
-                {
-                    if (packet.commands().robot_commands(i).id() < 0 || packet.commands().robot_commands(i).id() >15) continue;
-                    int k = packet.commands().robot_commands(i).id();
-                    int id = robotIndex(k, team);
-                    if ((id < 0) || (id >= cfg->Robots_Count()*2)) continue;
-                    bool wheels = false;
-                    if (packet.commands().robot_commands(i).has_wheelsspeed())
-                    {
-                        if (packet.commands().robot_commands(i).wheelsspeed())
-                        {
-                            if (packet.commands().robot_commands(i).has_wheel1()) robots[id]->setSpeed(0, packet.commands().robot_commands(i).wheel1());
-                            if (packet.commands().robot_commands(i).has_wheel2()) robots[id]->setSpeed(1, packet.commands().robot_commands(i).wheel2());
-                            if (packet.commands().robot_commands(i).has_wheel3()) robots[id]->setSpeed(2, packet.commands().robot_commands(i).wheel3());
-                            if (packet.commands().robot_commands(i).has_wheel4()) robots[id]->setSpeed(3, packet.commands().robot_commands(i).wheel4());
-                            wheels = true;
-                        }
-                    }
-                    if (!wheels)
-                    {
-                        dReal vx = 0;if (packet.commands().robot_commands(i).has_veltangent()) vx = packet.commands().robot_commands(i).veltangent();
-                        dReal vy = 0;if (packet.commands().robot_commands(i).has_velnormal())  vy = packet.commands().robot_commands(i).velnormal();
-                        dReal vw = 0;if (packet.commands().robot_commands(i).has_velangular()) vw = packet.commands().robot_commands(i).velangular();
-                        if(packet.commands().robot_commands(i).has_use_angle()) {
-                            if(packet.commands().robot_commands(i).use_angle()) {
-                                robots[id]->setAngle(vx, vy, vw);
-                            }
-                            else {
-                                robots[id]->setSpeed(vx, vy, vw);
-                            }
-                        }
-                        else{
-                            robots[id]->setSpeed(vx,vy,vw);
-                        }
-                    }
-                    if (packet.commands().robot_commands(i).has_geneva_angle())
-                    {
-                        // geneva_angle in radians
-                        robots[id]->kicker->rotateAbsolute(packet.commands().robot_commands(i).geneva_angle());
-                    }
-                    dReal kickx = 0 , kickz = 0;
-                    bool kick = false;
-                    if (packet.commands().robot_commands(i).has_kickspeedx())
-                    {
-                        kick = true;
-                        kickx = packet.commands().robot_commands(i).kickspeedx();
-                    }
-                    if (packet.commands().robot_commands(i).has_kickspeedz())
-                    {
-                        kick = true;
-                        kickz = packet.commands().robot_commands(i).kickspeedz();
-                    }
-                    if (kick && ((kickx>0.0001) || (kickz>0.0001)))
-                        robots[id]->kicker->kick(kickx,kickz);
-                    int rolling = 0;
-                    if (packet.commands().robot_commands(i).has_spinner())
-                    {
-                        if (packet.commands().robot_commands(i).spinner()) rolling = 1;
-                    }
-                    robots[id]->kicker->setRoller(rolling);
-                    char status = 0;
-                    status = k;
-                    if (robots[id]->kicker->isTouchingBall()) status = status | 8;
-                    if (robots[id]->on) status = status | 240;
-                    if (team == 0)
-                        blueStatusSocket->writeDatagram(&status,1,sender,cfg->BlueStatusSendPort());
-                    else
-                        yellowStatusSocket->writeDatagram(&status,1,sender,cfg->YellowStatusSendPort());
-
+                    command.mode = RobotCommand::WHEELS;
+                    for (int j=0;j<4;j++) command.wheel[j] = robots[id]->getSpeed(j);
+                    if (packet.commands().robot_commands(i).has_wheel1()) command.wheel[0] = packet.commands().robot_commands(i).wheel1();
+                    if (packet.commands().robot_commands(i).has_wheel2()) command.wheel[1] = packet.commands().robot_commands(i).wheel2();
+                    if (packet.commands().robot_commands(i).has_wheel3()) command.wheel[2] = packet.commands().robot_commands(i).wheel3();
+                    if (packet.commands().robot_commands(i).has_wheel4()) command.wheel[3] = packet.commands().robot_commands(i).wheel4();
+                    wheels = true;
                 }
             }
-            if (packet.has_replacement())
+            if (!wheels && packet.commands().robot_commands(i).has_trajectory())
             {
-                for (int i=0;i<packet.replacement().robots_size();i++)
+                const grSim_Trajectory &trajectory = packet.commands().robot_commands(i).trajectory();
+                const grSim_Trajectory_Point* source[TRAJECTORY_MAX_POINTS];
+                int n = 0;
+                for (int j=0;j<trajectory.points_size() && n<TRAJECTORY_MAX_POINTS;j++)
+                {
+                    const grSim_Trajectory_Point &point = trajectory.points(j);
+                    if (n > 0 && point.t() <= command.trajectory[n-1].t) continue;
+                    source[n] = &point;
+                    TrajectoryPoint &p = command.trajectory[n++];
+                    p.t = point.t();
+                    p.x = point.x();
+                    p.y = point.y();
+                    p.w = point.orientation();
+                    p.vx = point.vx();
+                    p.vy = point.vy();
+                    p.vw = point.vw();
+                }
+                // missing velocities are estimated from the neighbouring waypoints, the ends stand still
+                for (int j=1;j<n-1;j++)
                 {
-                    int team = 0;
-                    if (packet.replacement().robots(i).has_yellowteam())
-                    {
-                        if (packet.replacement().robots(i).yellowteam())
-                            team = 1;
-                    }
-                    if (!packet.replacement().robots(i).has_id()) continue;
-                    int k = packet.replacement().robots(i).id();
-                    dReal x = 0, y = 0, dir = 0;
-                    bool turnon = true;
-                    if (packet.replacement().robots(i).has_x()) x = packet.replacement().robots(i).x();
-                    if (packet.replacement().robots(i).has_y()) y = packet.replacement().robots(i).y();
-                    if (packet.replacement().robots(i).has_dir()) dir = packet.replacement().robots(i).dir();
-                    if (packet.replacement().robots(i).has_turnon()) turnon = packet.replacement().robots(i).turnon();
-                    int id = robotIndex(k, team);
-                    if ((id < 0) || (id >= cfg->Robots_Count()*2)) continue;
-                    robots[id]->setXY(x,y);
-                    robots[id]->resetRobot();
-                    robots[id]->setDir(dir);
-                    robots[id]->on = turnon;
+                    const TrajectoryPoint &a = command.trajectory[j-1], &b = command.trajectory[j+1];
+                    TrajectoryPoint &p = command.trajectory[j];
+                    dReal h = b.t - a.t;
+                    if (!source[j]->has_vx()) p.vx = (b.x - a.x)/h;
+                    if (!source[j]->has_vy()) p.vy = (b.y - a.y)/h;
+                    if (!source[j]->has_vw()) p.vw = Robot::constrainAngle(b.w - a.w)/h;
                 }
-                if (packet.replacement().has_ball())
+                command.trajectoryPoints = n;
+                command.trajectoryTime = 0;
+                if (trajectory.has_start_time())
+                    command.trajectoryTime = worldClock() - trajectory.start_time();
+                if (n > 0)
                 {
-                    dReal x = 0, y = 0, vx = 0, vy = 0;
-                    if (packet.replacement().ball().has_x())  x  = packet.replacement().ball().x();
-                    if (packet.replacement().ball().has_y())  y  = packet.replacement().ball().y();
-                    if (packet.replacement().ball().has_vx()) vx = packet.replacement().ball().vx();
-                    if (packet.replacement().ball().has_vy()) vy = packet.replacement().ball().vy();
-                    ball->setBodyPosition(x,y,cfg->BallRadius()*1.2);
-                    dBodySetLinearVel(ball->body,vx,vy,0);
-                    dBodySetAngularVel(ball->body,0,0,0);
+                    command.mode = RobotCommand::TRAJECTORY;
+                    wheels = true;
                 }
             }
+            if (!wheels)
+            {
+                command.vx = 0;if (packet.commands().robot_commands(i).has_veltangent()) command.vx = packet.commands().robot_commands(i).veltangent();
+                command.vy = 0;if (packet.commands().robot_commands(i).has_velnormal())  command.vy = packet.commands().robot_commands(i).velnormal();
+                command.vw = 0;if (packet.commands().robot_commands(i).has_velangular()) command.vw = packet.commands().robot_commands(i).velangular();
+                bool angle = packet.commands().robot_commands(i).has_use_angle() && packet.commands().robot_commands(i).use_angle();
+                bool pwm = packet.commands().robot_commands(i).has_use_pwm() && packet.commands().robot_commands(i).use_pwm();
+                if (pwm) command.mode = angle ? RobotCommand::PWM_ANGLE : RobotCommand::PWM;
+                else command.mode = angle ? RobotCommand::ANGLE : RobotCommand::VELOCITY;
+            }
+            if (packet.commands().robot_commands(i).has_geneva_angle())
+            {
+                // geneva_angle in radians
+                robots[id]->kicker->rotateAbsolute(packet.commands().robot_commands(i).geneva_angle());
+            }
+            dReal kickx = 0 , kickz = 0;
+            bool kick = false;
+            if (packet.commands().robot_commands(i).has_kickspeedx())
+            {
+                kick = true;
+                kickx = packet.commands().robot_commands(i).kickspeedx();
+            }
+            if (packet.commands().robot_commands(i).has_kickspeedz())
+            {
+                kick = true;
+                kickz = packet.commands().robot_commands(i).kickspeedz();
+            }
+            if (kick && ((kickx>0.0001) || (kickz>0.0001)))
+                robots[id]->kicker->kick(kickx,kickz);
+            int rolling = 0;
+            if (packet.commands().robot_commands(i).has_spinner())
+            {
+                if (packet.commands().robot_commands(i).spinner()) rolling = 1;
+            }
+            robots[id]->kicker->setRoller(rolling);
+            // byte 0: id | 8 touching ball | 240 on. With "Extended robot status" only, byte 1: flags (1 previous
+            // command had timed out, 2 kicker ready), bytes 2-3: milliseconds since the previous command for this
+            // robot (little endian, saturated)
+            char status[4];
+            int statusSize = cfg->ExtendedStatus() ? 4 : 1;
+            status[0] = k;
+            if (robots[id]->kicker->isTouchingBall()) status[0] = status[0] | 8;
+            if (robots[id]->on) status[0] = status[0] | 240;
+            status[1] = (wasStale ? 1 : 0) | (robots[id]->kicker->isReady() ? 2 : 0);
+            int ageMs = qMin(65535, (int)(lastAge*1000));
+            status[2] = ageMs & 0xff;
+            status[3] = (ageMs >> 8) & 0xff;
+            if (!senderPath.isEmpty())
+                localCommandSocket->writeDatagram(status,statusSize,senderPath);
+            else if (team == 0)
+                blueStatusSocket->writeDatagram(status,statusSize,sender,cfg->BlueStatusSendPort());
+            else
+                yellowStatusSocket->writeDatagram(status,statusSize,sender,cfg->YellowStatusSendPort());
+
+        }
+    }
+    if (packet.has_replacement())
+    {
+        for (int i=0;i<packet.replacement().robots_size();i++)
+        {
+            int team = 0;
+            if (packet.replacement().robots(i).has_yellowteam())
+            {
+                if (packet.replacement().robots(i).yellowteam())
+                    team = 1;
+            }
+            if (!packet.replacement().robots(i).has_id()) continue;
+            int k = packet.replacement().robots(i).id();
+            dReal x = 0, y = 0, dir = 0;
+            bool turnon = true;
+            if (packet.replacement().robots(i).has_x()) x = packet.replacement().robots(i).x();
+            if (packet.replacement().robots(i).has_y()) y = packet.replacement().robots(i).y();
+            if (packet.replacement().robots(i).has_dir()) dir = packet.replacement().robots(i).dir();
+            if (packet.replacement().robots(i).has_turnon()) turnon = packet.replacement().robots(i).turnon();
+            int id = robotIndex(k, team);
+            if ((id < 0) || (id >= cfg->Robots_Count()*2)) continue;
+            robots[id]->setXY(x,y);
+            robots[id]->resetRobot();
+            robots[id]->setDir(dir);
+            robots[id]->on = turnon;
+            commands[id].mode = RobotCommand::NONE;
+        }
+        if (packet.replacement().has_ball())
+        {
+            dReal x = 0, y = 0, vx = 0, vy = 0;
+            if (packet.replacement().ball().has_x())  x  = packet.replacement().ball().x();
+            if (packet.replacement().ball().has_y())  y  = packet.replacement().ball().y();
+            if (packet.replacement().ball().has_vx()) vx = packet.replacement().ball().vx();
+            if (packet.replacement().ball().has_vy()) vy = packet.replacement().ball().vy();
+            releaseBall();
+            ball->setBodyPosition(x,y,cfg->BallRadius()*1.2);
+            dBodySetLinearVel(ball->body,vx,vy,0);
+            dBodySetAngularVel(ball->body,0,0,0);
         }
     }
 }
 
+void SSLWorld::releaseBall()
+{
+    for (int k=0;k<cfg->Robots_Count()*2;k++)
+        robots[k]->kicker->drop();
+}
+
 dReal normalizeAngle(dReal a)
 {
     if (a>180) return -360+a;
@@ -632,51 +786,158 @@ dReal normalizeAngle(dReal a)
     return a;
 }
 
-bool SSLWorld::visibleInCam(int id, double x, double y)
+// Rebuilds the camera layout when the camera settings changed, field size changes restart the world
+void SSLWorld::updateCameraLayout()
 {
+    QString file = QString::fromStdString(cfg->CameraLayoutFile());
+    if (layoutCameras == cfg->nCameras() && layoutOverlap == cfg->CameraOverlap() && layoutHeight == cfg->CameraHeight()
+        && layoutFile == file) return;
+    layoutCameras = cfg->nCameras();
+    layoutOverlap = cfg->CameraOverlap();
+    layoutHeight = cfg->CameraHeight();
+    layoutFile = file;
+    // the schedule restarts with the new cameras
+    scheduleRate = -1;
+    if (!file.isEmpty() && cameraLayout.loadFromIniFile(qApp->applicationDirPath() + QString("/../config/") + file, layoutHeight))
+        return;
+    cameraLayout.fromField(layoutCameras, cfg->Field_Length(), cfg->Field_Width(), cfg->Field_Margin(), layoutOverlap, layoutHeight);
+}
 
-    switch (getAmountOfCameras()) {
-    case EIGHT:
-        return  (id==0 && x<-2.5          && y>-0.5) || (id==1 && x<0.5 && x>-3.5 && y>-0.5) ||
-                (id==2 && x>-0.5 && x<3.5 && y>-0.5) || (id==3 && x>2.5           && y>-0.5) ||
-                (id==4 && x<-2.5          && y<0.5 ) || (id==5 && x<0.5 && x>-3.5 && y<0.5 ) ||
-                (id==6 && x>-0.5 && x<3.5 && y<0.5 ) || (id==7 && x>2.5           && y<0.5 );
-
-    case FOUR:
-        return  (id==0 && x<0.5           && y>-0.5) || (id==1 && x>-0.5          && y>-0.5) ||
-                (id==2 && x<0.5           && y<0.5 ) || (id==3 && x>-0.5          && y<0.5 );
+void SSLWorld::takeSnapshot(WorldSnapshot& snapshot)
+{
+    ball->getBodyPosition(snapshot.ballX,snapshot.ballY,snapshot.ballZ);
+    for (int k=0;k<cfg->Robots_Count()*2;k++)
+    {
+        robots[k]->getXY(snapshot.robotX[k],snapshot.robotY[k]);
+        snapshot.robotDir[k] = robots[k]->getDir();
+        snapshot.robotOn[k] = robots[k]->on;
+    }
+}
 
-    case TWO:
-        return  (id==0 && x<0.5                    ) || (id==1 && x>-0.5                   );
+// Poses a fraction f of the way from a to b
+void SSLWorld::interpolateSnapshot(const WorldSnapshot& a, const WorldSnapshot& b, dReal f, WorldSnapshot& out)
+{
+    out.ballX = a.ballX + f*(b.ballX - a.ballX);
+    out.ballY = a.ballY + f*(b.ballY - a.ballY);
+    out.ballZ = a.ballZ + f*(b.ballZ - a.ballZ);
+    for (int k=0;k<cfg->Robots_Count()*2;k++)
+    {
+        out.robotX[k] = a.robotX[k] + f*(b.robotX[k] - a.robotX[k]);
+        out.robotY[k] = a.robotY[k] + f*(b.robotY[k] - a.robotY[k]);
+        out.robotDir[k] = normalizeAngle(a.robotDir[k] + f*normalizeAngle(b.robotDir[k] - a.robotDir[k]));
+        out.robotOn[k] = b.robotOn[k];
+    }
+}
 
-    case ONE:
-    default:
-        return  (id==0                             );
+void SSLWorld::resetCameraSchedule()
+{
+    scheduleRate = cfg->CameraRate();
+    schedulePhaseStep = cfg->CameraPhaseStep();
+    for (int c=0;c<cameraLayout.count();c++)
+    {
+        double rate = cameraLayout.captureRate(c, scheduleRate);
+        nextCapture[c] = (rate > 0) ? simTime + cameraLayout.capturePhase(c, c*schedulePhaseStep) : 1e100;
+    }
+    takeSnapshot(lastSnapshot);
+}
 
+// Captures the cameras that were due during the last physics substep of length dt. Every camera runs at its
+// own rate and phase on simulated time, and sees the poses interpolated to its capture time between the
+// end of the previous substep and now. Cameras with the same capture time share one pass over the objects.
+void SSLWorld::captureCameras(dReal dt)
+{
+    updateCameraLayout();
+    if (scheduleRate != cfg->CameraRate() || schedulePhaseStep != cfg->CameraPhaseStep()) resetCameraSchedule();
+    WorldSnapshot now, at;
+    takeSnapshot(now);
+    for (;;)
+    {
+        dReal t_capture = 1e100;
+        for (int c=0;c<cameraLayout.count();c++)
+            if (nextCapture[c] < t_capture) t_capture = nextCapture[c];
+        if (t_capture > simTime) break;
+        uint32_t cameras = 0;
+        for (int c=0;c<cameraLayout.count();c++)
+            if (nextCapture[c] <= t_capture + 1e-9) cameras |= 1u << c;
+        dReal f = (dt > 0) ? 1 - (simTime - t_capture)/dt : 1;
+        interpolateSnapshot(lastSnapshot, now, qMax(f, (dReal)0), at);
+        captureFrame(at, cameras, timeOrigin + t_capture);
+        for (int c=0;c<cameraLayout.count();c++)
+            if (cameras & (1u << c)) nextCapture[c] += 1.0/cameraLayout.captureRate(c, scheduleRate);
     }
+    lastSnapshot = now;
 }
 
 #define CONVUNIT(x) ((int)(1000*(x)))
-SSL_WrapperPacket* SSLWorld::generatePacket(int cam_id)
+// Hands a capture of the given cameras to the vision sender, with the cameras that see each object
+void SSLWorld::captureFrame(const WorldSnapshot& snapshot, uint32_t cameras, dReal t_capture)
 {
-    SSL_WrapperPacket* packet = new SSL_WrapperPacket;
-    dReal x,y,z,dir;
-    ball->getBodyPosition(x,y,z);
-    packet->mutable_detection()->set_camera_id(cam_id);
-    packet->mutable_detection()->set_frame_number(framenum);
-    dReal t_elapsed = QDateTime::currentMSecsSinceEpoch()/1000.0;
-    packet->mutable_detection()->set_t_capture(t_elapsed);
-    packet->mutable_detection()->set_t_sent(t_elapsed);
-    dReal dev_x = cfg->noiseDeviation_x();
-    dReal dev_y = cfg->noiseDeviation_y();
-    dReal dev_a = cfg->noiseDeviation_angle();
-    if (sendGeomCount++ % cfg->sendGeometryEvery() == 0)
+    VisionFrame frame;
+    int ids[MAX_CAMERA_COUNT];
+    frame.snapshot = snapshot;
+    frame.robotCount = cfg->Robots_Count();
+    frame.cameras = cameras;
+    frame.t_capture = t_capture;
+    frame.jitterModel = JITTER_GAUSSIAN;
+    if (cfg->sendJitterModel() == "Uniform") frame.jitterModel = JITTER_UNIFORM;
+    else if (cfg->sendJitterModel() == "Exponential") frame.jitterModel = JITTER_EXPONENTIAL;
+    frame.noiseSeed = cfg->noiseSeed();
+    frame.noise = cfg->noise();
+    frame.deviationX = cfg->noiseDeviation_x();
+    frame.deviationY = cfg->noiseDeviation_y();
+    frame.deviationAngle = cfg->noiseDeviation_angle();
+    frame.vanishing = cfg->vanishing();
+    frame.ballVanishing = cfg->ball_vanishing();
+    frame.blueVanishing = cfg->blue_team_vanishing();
+    frame.yellowVanishing = cfg->yellow_team_vanishing();
+    frame.payloadBudget = cfg->VisionPayloadBudget();
+    for (int c=0;c<cameraLayout.count();c++)
+    {
+        frame.latency[c] = cameraLayout.sendLatency(c, cfg->sendDelay());
+        frame.jitter[c] = cameraLayout.sendJitter(c, cfg->sendJitter());
+    }
+    frame.ballCameras = 0;
+    int n = cameraLayout.camerasContaining(snapshot.ballX, snapshot.ballY, ids);
+    for (int c=0;c<n;c++) frame.ballCameras |= 1u << ids[c];
+    frame.ballCameras &= cameras;
+    // the ball is hidden from the cameras whose line of sight to it passes through a robot
+    if (cfg->Occlusion() && frame.ballCameras)
+    {
+        occlusion.clear();
+        // robots that are off still stand on the field
+        for (int i=0;i<frame.robotCount*2;i++)
+            occlusion.add(snapshot.robotX[i], snapshot.robotY[i], robotSettings[i].RobotRadius,
+                          robotSettings[i].BottomHeight + robotSettings[i].RobotHeight);
+        for (int c=0;c<cameraLayout.count();c++)
+        {
+            if (!(frame.ballCameras & (1u << c))) continue;
+            const CameraPosition& camera = cameraLayout.position(c);
+            if (occlusion.occluded(snapshot.ballX, snapshot.ballY, snapshot.ballZ, camera.x, camera.y, camera.z))
+                frame.ballCameras &= ~(1u << c);
+        }
+    }
+    for (int i=0;i<frame.robotCount*2;i++)
     {
-        SSL_GeometryData* geom = packet->mutable_geometry();
-        SSL_GeometryFieldSize* field = geom->mutable_field();
+        frame.robotCameras[i] = 0;
+        if (!snapshot.robotOn[i]) continue;
+        n = cameraLayout.camerasContaining(snapshot.robotX[i], snapshot.robotY[i], ids);
+        for (int c=0;c<n;c++) frame.robotCameras[i] |= 1u << ids[c];
+        frame.robotCameras[i] &= cameras;
+    }
+    if (cfg->VisionThread()) visionSender->publish(frame);
+    else visionSender->process(frame);
+}
 
+// The geometry only changes with the field settings, and editing those restarts the world, so it is serialized
+// once per world and sent as a datagram of its own
+void SSLWorld::buildGeometry()
+{
+    SSL_WrapperPacket packet;
+    SSL_GeometryData* geom = packet.mutable_geometry();
+    SSL_GeometryFieldSize* field = geom->mutable_field();
 
-        // Old protocol
+
+    // Old protocol
 //        field->set_line_width(CONVUNIT(cfg->Field_Line_Width()));
 //        field->set_referee_width(CONVUNIT(cfg->Field_Referee_Margin()));
 //        field->set_goal_wall_width(CONVUNIT(cfg->Goal_Thickness()));
@@ -684,73 +945,24 @@ SSL_WrapperPacket* SSLWorld::generatePacket(int cam_id)
 //        field->set_defense_radius(CONVUNIT(cfg->Field_Defense_Rad()));
 //        field->set_defense_stretch(CONVUNIT(cfg->Field_Defense_Stretch()));
 //        field->set_free_kick_from_defense_dist(CONVUNIT(cfg->Field_Free_Kick()));
-        //TODO: verify if these fields are correct:
+    //TODO: verify if these fields are correct:
 //        field->set_penalty_line_from_spot_dist(CONVUNIT(cfg->Field_Penalty_Line()));
 //        field->set_penalty_spot_from_field_line_dist(CONVUNIT(cfg->Field_Penalty_Point()));
 
-        // Current protocol (2015+)
-        // Field general info
-        field->set_field_length(CONVUNIT(cfg->Field_Length()));
-        field->set_field_width(CONVUNIT(cfg->Field_Width()));
-        field->set_boundary_width(CONVUNIT(cfg->Field_Margin()));
-        field->set_goal_width(CONVUNIT(cfg->Goal_Width()));
-        field->set_goal_depth(CONVUNIT(cfg->Goal_Depth()));
-
-        // Field lines and arcs
-        addFieldLinesArcs(field);
-
-    }
-    // vanishing robots
-    if (! cfg->noise()) { dev_x = 0;dev_y = 0;dev_a = 0;}
-    if (! cfg->vanishing() || (rand0_1() > cfg->ball_vanishing()))
-    {
-        if (visibleInCam(cam_id, x, y)) {
-            SSL_DetectionBall* vball = packet->mutable_detection()->add_balls();
-            vball->set_x(randn_notrig(x*1000.0f,dev_x));
-            vball->set_y(randn_notrig(y*1000.0f,dev_y));
-            vball->set_z(z*1000.0f);
-            vball->set_pixel_x(x*1000.0f);
-            vball->set_pixel_y(y*1000.0f);
-            vball->set_confidence(0.9 + rand0_1()*0.1);
-        }
-    }
-    for(int i = 0; i < cfg->Robots_Count(); i++){
-        if (! cfg->vanishing() || (rand0_1() > cfg->blue_team_vanishing()))
-        {
-            if (!robots[i]->on) continue;
-            robots[i]->getXY(x,y);
-            dir = robots[i]->getDir();
-            if (visibleInCam(cam_id, x, y)) {
-                SSL_DetectionRobot* rob = packet->mutable_detection()->add_robots_blue();
-                rob->set_robot_id(i);
-                rob->set_pixel_x(x*1000.0f);
-                rob->set_pixel_y(y*1000.0f);
-                rob->set_confidence(1);
-                rob->set_x(randn_notrig(x*1000.0f,dev_x));
-                rob->set_y(randn_notrig(y*1000.0f,dev_y));
-                rob->set_orientation(normalizeAngle(randn_notrig(dir,dev_a))*M_PI/180.0f);
-            }
-        }
-    }
-    for(int i = cfg->Robots_Count(); i < cfg->Robots_Count()*2; i++){
-        if (! cfg->vanishing() || (rand0_1() > cfg->yellow_team_vanishing()))
-        {
-            if (!robots[i]->on) continue;
-            robots[i]->getXY(x,y);
-            dir = robots[i]->getDir();
-            if (visibleInCam(cam_id, x, y)) {
-                SSL_DetectionRobot* rob = packet->mutable_detection()->add_robots_yellow();
-                rob->set_robot_id(i-cfg->Robots_Count());
-                rob->set_pixel_x(x*1000.0f);
-                rob->set_pixel_y(y*1000.0f);
-                rob->set_confidence(1);
-                rob->set_x(randn_notrig(x*1000.0f,dev_x));
-                rob->set_y(randn_notrig(y*1000.0f,dev_y));
-                rob->set_orientation(normalizeAngle(randn_notrig(dir,dev_a))*M_PI/180.0f);
-            }
-        }
-    }
-    return packet;
+    // Current protocol (2015+)
+    // Field general info
+    field->set_field_length(CONVUNIT(cfg->Field_Length()));
+    field->set_field_width(CONVUNIT(cfg->Field_Width()));
+    field->set_boundary_width(CONVUNIT(cfg->Field_Margin()));
+    field->set_goal_width(CONVUNIT(cfg->Goal_Width()));
+    field->set_goal_depth(CONVUNIT(cfg->Goal_Depth()));
+
+    // Field lines and arcs
+    addFieldLinesArcs(field);
+    packet.SerializeToString(&geometryDatagram);
+    // the field is a single message, there is nothing to split it along
+    if (cfg->VisionPayloadBudget() > 0 && (int) geometryDatagram.size() > cfg->VisionPayloadBudget())
+        logStatus(QString("Geometry datagram of %1 bytes exceeds the vision payload budget").arg((int) geometryDatagram.size()), QColor("orange"));
 }
 
 void SSLWorld::addFieldLinesArcs(SSL_GeometryFieldSize *field) {
@@ -825,37 +1037,88 @@ void SSLWorld::addFieldArc(SSL_GeometryFieldSize *field, const std::string &name
     arc->set_thickness(thickness);
 }
 
-SendingPacket::SendingPacket(SSL_WrapperPacket* _packet,int _t)
+void SSLWorld::sendVisionBuffer()
 {
-    packet = _packet;
-    t      = _t;
-}
-
-SSLWorld::AmountOfCameras SSLWorld::getAmountOfCameras() {
-
-    int totalCamsInInterface = cfg->nCameras();
-    return totalCamsInInterface>=8 ? EIGHT :
-           totalCamsInInterface>=4 ? FOUR :
-           totalCamsInInterface>=2 ? TWO :
-                                     ONE;
+    dReal t = worldClock();
+    // without a capture rate all cameras capture once per physics frame, otherwise captureCameras queued them
+    if (cfg->CameraRate() <= 0)
+    {
+        updateCameraLayout();
+        WorldSnapshot snapshot;
+        takeSnapshot(snapshot);
+        captureFrame(snapshot, (1u << cameraLayout.count()) - 1, t);
+    }
+    if (sendGeomCount++ % cfg->sendGeometryEvery() == 0)
+    {
+        if (geometryDatagram.empty()) buildGeometry();
+        visionServer->send(geometryDatagram.data(), geometryDatagram.size());
+        for (int s=0;s<visionSender->subscriberCount();s++)
+            visionSender->subscriberServer(s)->send(geometryDatagram.data(), geometryDatagram.size());
+    }
+    // threaded, the sender follows the world clock and sends on its own
+    if (cfg->VisionThread())
+    {
+        visionSender->setClock(t);
+        if (!visionSender->isRunning())
+        {
+            visionSender->server = visionServer;
+            visionSender->start(QThread::HighPriority);
+        }
+    }
+    else
+    {
+        visionSender->server = visionServer;
+        visionSender->sendDue(t);
+    }
 }
 
-void SSLWorld::sendVisionBuffer()
+// Exact state at the end of the step, at GroundTruthRate on simulated time or every frame. The message and
+// its buffer are kept, so every robot reuses its submessage of the previous frame.
+void SSLWorld::sendGroundTruth()
 {
-    int t = QDateTime::currentMSecsSinceEpoch();
-    int amountOfCameras = 8;
-    for (int i = 0; i < amountOfCameras; i++) {
-        sendQueue.push_back(new SendingPacket(generatePacket(i),t+i));
+    if (groundTruthServer == NULL) return;
+    if (cfg->GroundTruthRate() > 0)
+    {
+        if (simTime < nextGroundTruth) return;
+        nextGroundTruth += 1.0/cfg->GroundTruthRate();
+        if (nextGroundTruth < simTime) nextGroundTruth = simTime + 1.0/cfg->GroundTruthRate();
     }
-
-    while (t - sendQueue.front()->t>=cfg->sendDelay()) {
-        SSL_WrapperPacket *packet = sendQueue.front()->packet;
-        delete sendQueue.front();
-        sendQueue.pop_front();
-        visionServer->send(*packet);
-        delete packet;
-        if (sendQueue.isEmpty()) break;
+    dReal x,y,z;
+    groundTruth.Clear();
+    groundTruth.set_frame(framenum);
+    groundTruth.set_time(worldClock());
+    grSim_GroundTruth_Ball* gball = groundTruth.mutable_ball();
+    ball->getBodyPosition(x,y,z);
+    const dReal* v = dBodyGetLinearVel(ball->body);
+    const dReal* w = dBodyGetAngularVel(ball->body);
+    gball->set_x(x);
+    gball->set_y(y);
+    gball->set_z(z);
+    gball->set_vx(v[0]);
+    gball->set_vy(v[1]);
+    gball->set_vz(v[2]);
+    gball->set_wx(w[0]);
+    gball->set_wy(w[1]);
+    gball->set_wz(w[2]);
+    for (int k=0;k<cfg->Robots_Count()*2;k++)
+    {
+        bool blue = k < cfg->Robots_Count();
+        grSim_GroundTruth_Robot* rob = blue ? groundTruth.add_robots_blue() : groundTruth.add_robots_yellow();
+        robots[k]->getXY(x,y);
+        v = dBodyGetLinearVel(robots[k]->chassis->body);
+        w = dBodyGetAngularVel(robots[k]->chassis->body);
+        rob->set_id(blue ? k : k-cfg->Robots_Count());
+        rob->set_x(x);
+        rob->set_y(y);
+        rob->set_orientation(robots[k]->getDir()*M_PI/180.0);
+        rob->set_vx(v[0]);
+        rob->set_vy(v[1]);
+        rob->set_vw(w[2]);
+        rob->set_flags((robots[k]->on ? 1 : 0) | (robots[k]->kicker->isTouchingBall() ? 2 : 0)
+                       | (robots[k]->kicker->isReady() ? 4 : 0) | (robots[k]->kicker->getRoller() ? 8 : 0));
     }
+    groundTruth.SerializeToString(&groundTruthDatagram);
+    groundTruthServer->send(groundTruthDatagram.data(), groundTruthDatagram.size());
 }
 
 void RobotsFormation::setAll(dReal* xx,dReal *yy)
@@ -1025,128 +1288,3 @@ void RobotsFormation::resize(double xScale, double yScale)
         y[k] = y[k] * yScale;
     }
 }
-
-
-
-
-//// Copy & pasted from http://www.dreamincode.net/code/snippet1446.htm
-/******************************************************************************/
-/* randn()
- *
- * Normally (Gaussian) distributed random numbers, using the Box-Muller
- * transformation.  This transformation takes two uniformly distributed deviates
- * within the unit circle, and transforms them into two independently
- * distributed normal deviates.  Utilizes the internal rand() function; this can
- * easily be changed to use a better and faster RNG.
- *
- * The parameters passed to the function are the mean and standard deviation of
- * the desired distribution.  The default values used, when no arguments are
- * passed, are 0 and 1 - the standard normal distribution.
- *
- *
- * Two functions are provided:
- *
- * The first uses the so-called polar version of the B-M transformation, using
- * multiple calls to a uniform RNG to ensure the initial deviates are within the
- * unit circle.  This avoids making any costly trigonometric function calls.
- *
- * The second makes only a single set of calls to the RNG, and calculates a
- * position within the unit circle with two trigonometric function calls.
- *
- * The polar version is generally superior in terms of speed; however, on some
- * systems, the optimization of the math libraries may result in better
- * performance of the second.  Try it out on the target system to see which
- * works best for you.  On my test machine (Athlon 3800+), the non-trig version
- * runs at about 3x10^6 calls/s; while the trig version runs at about
- * 1.8x10^6 calls/s (-O2 optimization).
- *
- *
- * Example calls:
- * randn_notrig();	//returns normal deviate with mean=0.0, std. deviation=1.0
- * randn_notrig(5.2,3.0);	//returns deviate with mean=5.2, std. deviation=3.0
- *
- *
- * Dependencies - requires <cmath> for the sqrt(), sin(), and cos() calls, and a
- * #defined value for PI.
- */
-
-/******************************************************************************/
-//	"Polar" version without trigonometric calls
-dReal randn_notrig(dReal mu, dReal sigma) {
-    if (sigma==0) return mu;
-    static bool deviateAvailable=false;	//	flag
-    static dReal storedDeviate;			//	deviate from previous calculation
-    dReal polar, rsquared, var1, var2;
-
-    //	If no deviate has been stored, the polar Box-Muller transformation is
-    //	performed, producing two independent normally-distributed random
-    //	deviates.  One is stored for the next round, and one is returned.
-    if (!deviateAvailable) {
-
-        //	choose pairs of uniformly distributed deviates, discarding those
-        //	that don't fall within the unit circle
-        do {
-            var1=2.0*( dReal(rand())/dReal(RAND_MAX) ) - 1.0;
-            var2=2.0*( dReal(rand())/dReal(RAND_MAX) ) - 1.0;
-            rsquared=var1*var1+var2*var2;
-        } while ( rsquared>=1.0 || rsquared == 0.0);
-
-        //	calculate polar tranformation for each deviate
-        polar=sqrt(-2.0*log(rsquared)/rsquared);
-
-        //	store first deviate and set flag
-        storedDeviate=var1*polar;
-        deviateAvailable=true;
-
-        //	return second deviate
-        return var2*polar*sigma + mu;
-    }
-
-    //	If a deviate is available from a previous call to this function, it is
-    //	returned, and the flag is set to false.
-    else {
-        deviateAvailable=false;
-        return storedDeviate*sigma + mu;
-    }
-}
-
-
-/******************************************************************************/
-//	Standard version with trigonometric calls
-#define PI 3.14159265358979323846
-
-dReal randn_trig(dReal mu, dReal sigma) {
-    static bool deviateAvailable=false;	//	flag
-    static dReal storedDeviate;			//	deviate from previous calculation
-    dReal dist, angle;
-
-    //	If no deviate has been stored, the standard Box-Muller transformation is
-    //	performed, producing two independent normally-distributed random
-    //	deviates.  One is stored for the next round, and one is returned.
-    if (!deviateAvailable) {
-
-        //	choose a pair of uniformly distributed deviates, one for the
-        //	distance and one for the angle, and perform transformations
-        dist=sqrt( -2.0 * log(dReal(rand()) / dReal(RAND_MAX)) );
-        angle=2.0 * PI * (dReal(rand()) / dReal(RAND_MAX));
-
-        //	calculate and store first deviate and set flag
-        storedDeviate=dist*cos(angle);
-        deviateAvailable=true;
-
-        //	calculate return second deviate
-        return dist * sin(angle) * sigma + mu;
-    }
-
-    //	If a deviate is available from a previous call to this function, it is
-    //	returned, and the flag is set to false.
-    else {
-        deviateAvailable=false;
-        return storedDeviate*sigma + mu;
-    }
-}
-
-dReal rand0_1()
-{
-    return (dReal) (rand()) / (dReal) (RAND_MAX);
-}
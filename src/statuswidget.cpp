@@ -53,10 +53,12 @@ void CStatusWidget::write(QString str, QColor color)
 void CStatusWidget::update()
 {
     CStatusText text;
+    statusPrinter->mutex.lock();
     while(!statusPrinter->textBuffer.isEmpty())
     {
         text = statusPrinter->textBuffer.dequeue();
         write(text.text, text.color);
     }
+    statusPrinter->mutex.unlock();
 }
 
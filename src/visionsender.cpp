@@ -0,0 +1,339 @@
+/*
+grSim - RoboCup Small Size Soccer Robots Simulator
+Copyright (C) 2011, Parsian Robotic Center (eew.aut.ac.ir/~parsian/grsim)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "visionsender.h"
+#include "logger.h"
+#include <QUdpSocket>
+
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <google/protobuf/io/coded_stream.h>
+
+dReal normalizeAngle(dReal a);
+
+static dReal steadyTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+VisionSender::VisionSender() :
+    server(0),
+    nSubscribers(0),
+    seededWith(-1),
+    clockOffset(0),
+    droppedFrames(0)
+{
+    for (int c=0;c<MAX_CAMERA_COUNT;c++)
+    {
+        cameraFrames[c] = 0;
+        for (int d=0;d<DELAY_LINE_DESTINATIONS;d++) lastRelease[d][c] = 0;
+    }
+    lateness.sum = lateness.max = 0;
+    lateness.count = 0;
+    memset(&packetStats, 0, sizeof(packetStats));
+}
+
+// Hands a frame to the sender thread, the frame is dropped when the thread falls behind
+bool VisionSender::publish(const VisionFrame& frame)
+{
+    VisionFrame* slot = queue.back();
+    if (!slot)
+    {
+        droppedFrames++;
+        return false;
+    }
+    *slot = frame;
+    queue.push();
+    return true;
+}
+
+// Detection packets of the cameras of a frame. Vanishing is drawn once per object, then the noise of all
+// detections of the frame is drawn in one batch and handed out in the order the detections are built. The
+// packets of the cameras are kept and cleared for every frame, so the detections reuse the messages allocated for
+// earlier frames. Each packet is serialized once into the delay line, released to the vision server after the
+// latency of its camera and to every subscriber after the subscriber's delay; frames of one camera are never
+// reordered by the jitter. t_sent is the release time on the vision server. Packets larger than the payload budget
+// are split into sub-frames.
+void VisionSender::process(const VisionFrame& frame)
+{
+    const WorldSnapshot& snapshot = frame.snapshot;
+    dReal x,y,z,dir;
+    if (frame.noiseSeed != seededWith)
+    {
+        seededWith = frame.noiseSeed;
+        random.seed(seededWith != 0 ? seededWith : std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+    for (int c=0;c<MAX_CAMERA_COUNT;c++)
+    {
+        if (!(frame.cameras & (1u << c))) continue;
+        packets[c].Clear();
+        packets[c].mutable_detection()->set_camera_id(c);
+        packets[c].mutable_detection()->set_frame_number(cameraFrames[c]++);
+        packets[c].mutable_detection()->set_t_capture(frame.t_capture);
+    }
+    // vanishing objects are seen by no camera
+    uint32_t ballCameras = frame.ballCameras;
+    uint32_t robotCameras[MAX_ROBOT_COUNT*2];
+    int count = 2*std::bitset<32>(ballCameras).count();
+    if (frame.vanishing && (random.uniform() <= frame.ballVanishing)) ballCameras = 0;
+    for(int i = 0; i < frame.robotCount*2; i++){
+        bool blue = i < frame.robotCount;
+        robotCameras[i] = frame.robotCameras[i];
+        if (robotCameras[i] && frame.vanishing && (random.uniform() <= (blue ? frame.blueVanishing : frame.yellowVanishing)))
+            robotCameras[i] = 0;
+        count += 3*std::bitset<32>(robotCameras[i]).count();
+    }
+    if (frame.noise) random.gaussian(noise, count);
+    else memset(noise, 0, count*sizeof(double));
+    const double* g = noise;
+    dReal dev_x = frame.deviationX;
+    dReal dev_y = frame.deviationY;
+    dReal dev_a = frame.deviationAngle;
+    x = snapshot.ballX;
+    y = snapshot.ballY;
+    z = snapshot.ballZ;
+    for (int c=0;c<MAX_CAMERA_COUNT;c++)
+    {
+        if (!(ballCameras & (1u << c))) continue;
+        SSL_DetectionBall* vball = packets[c].mutable_detection()->add_balls();
+        vball->set_x(x*1000.0f + dev_x*g[0]);
+        vball->set_y(y*1000.0f + dev_y*g[1]);
+        g += 2;
+        vball->set_z(z*1000.0f);
+        vball->set_pixel_x(x*1000.0f);
+        vball->set_pixel_y(y*1000.0f);
+        vball->set_confidence(0.9 + random.uniform()*0.1);
+    }
+    for(int i = 0; i < frame.robotCount*2; i++){
+        bool blue = i < frame.robotCount;
+        if (!robotCameras[i]) continue;
+        x = snapshot.robotX[i];
+        y = snapshot.robotY[i];
+        dir = snapshot.robotDir[i];
+        for (int c=0;c<MAX_CAMERA_COUNT;c++)
+        {
+            if (!(robotCameras[i] & (1u << c))) continue;
+            SSL_DetectionFrame* detection = packets[c].mutable_detection();
+            SSL_DetectionRobot* rob = blue ? detection->add_robots_blue() : detection->add_robots_yellow();
+            rob->set_robot_id(blue ? i : i-frame.robotCount);
+            rob->set_pixel_x(x*1000.0f);
+            rob->set_pixel_y(y*1000.0f);
+            rob->set_confidence(1);
+            rob->set_x(x*1000.0f + dev_x*g[0]);
+            rob->set_y(y*1000.0f + dev_y*g[1]);
+            rob->set_orientation(normalizeAngle(dir + dev_a*g[2])*M_PI/180.0f);
+            g += 3;
+        }
+    }
+    double release[DELAY_LINE_DESTINATIONS];
+    PacketStats frameStats;
+    memset(&frameStats, 0, sizeof(frameStats));
+    int budget = frame.payloadBudget;
+    for (int c=0;c<MAX_CAMERA_COUNT;c++)
+    {
+        if (!(frame.cameras & (1u << c))) continue;
+        release[0] = releaseTime(0, c, frame.t_capture, frame.latency[c], frame.jitter[c], frame.jitterModel);
+        uint32_t destinations = 1;
+        int frameNumber = packets[c].detection().frame_number();
+        for (int s=0;s<nSubscribers;s++)
+        {
+            const VisionSubscriber& sub = subscribers[s];
+            if (sub.decimation > 1 && frameNumber % sub.decimation != 0) continue;
+            if (sub.loss > 0 && random.uniform() < sub.loss) continue;
+            release[s+1] = releaseTime(s+1, c, frame.t_capture, sub.delay, sub.jitter, frame.jitterModel);
+            destinations |= 1u << (s+1);
+        }
+        packets[c].mutable_detection()->set_t_sent(release[0]);
+        pushDetection(c, release, destinations, budget, frameStats);
+    }
+    statsMutex.lock();
+    packetStats.frames++;
+    packetStats.datagrams += frameStats.datagrams;
+    packetStats.splitPackets += frameStats.splitPackets;
+    packetStats.bytes += frameStats.bytes;
+    if (frameStats.largest > packetStats.largest) packetStats.largest = frameStats.largest;
+    statsMutex.unlock();
+}
+
+// Queues the packet of camera c. When it is larger than budget bytes its balls and robots are spread over
+// sub-frames with the same camera, frame number and times, each holding as many objects as fit in the budget
+// and at least one. Returns the number of datagrams.
+int VisionSender::pushDetection(int c, const double* release, uint32_t destinations, int budget, PacketStats& stats)
+{
+    const SSL_DetectionFrame& full = packets[c].detection();
+    int datagrams = 0;
+    if (budget <= 0 || (int) packets[c].ByteSizeLong() <= budget)
+    {
+        int size = delayLine.push(packets[c], release, destinations);
+        if (size >= 0)
+        {
+            datagrams = 1;
+            stats.bytes += size;
+            stats.largest = qMax(stats.largest, size);
+        }
+    }
+    else
+    {
+        int balls = full.balls_size(), yellow = full.robots_yellow_size();
+        int n = balls + yellow + full.robots_blue_size();
+        int i = 0;
+        stats.splitPackets++;
+        while (i < n)
+        {
+            SSL_DetectionFrame* part = split.mutable_detection();
+            part->Clear();
+            part->set_frame_number(full.frame_number());
+            part->set_t_capture(full.t_capture());
+            part->set_t_sent(full.t_sent());
+            part->set_camera_id(full.camera_id());
+            // the length of the detection in the wrapper may grow by a byte or two
+            int size = split.ByteSizeLong() + 2;
+            for (int added = 0; i < n; added++, i++)
+            {
+                const google::protobuf::MessageLite& item = i < balls ? (const google::protobuf::MessageLite&) full.balls(i)
+                    : i < balls + yellow ? (const google::protobuf::MessageLite&) full.robots_yellow(i - balls)
+                    : (const google::protobuf::MessageLite&) full.robots_blue(i - balls - yellow);
+                int itemSize = item.ByteSizeLong();
+                itemSize += 1 + google::protobuf::io::CodedOutputStream::VarintSize32(itemSize);
+                if (added > 0 && size + itemSize > budget) break;
+                size += itemSize;
+                if (i < balls) part->add_balls()->CopyFrom(full.balls(i));
+                else if (i < balls + yellow) part->add_robots_yellow()->CopyFrom(full.robots_yellow(i - balls));
+                else part->add_robots_blue()->CopyFrom(full.robots_blue(i - balls - yellow));
+            }
+            int pushed = delayLine.push(split, release, destinations);
+            if (pushed < 0) break;
+            datagrams++;
+            stats.bytes += pushed;
+            stats.largest = qMax(stats.largest, pushed);
+        }
+    }
+    if (datagrams == 0)
+        logStatus(QString("Vision delay line full, dropped a packet of camera %1").arg(c), QColor("orange"));
+    stats.datagrams += datagrams;
+    return datagrams;
+}
+
+// Release time of a packet of camera c for destination d, not before the previous packet of that camera
+dReal VisionSender::releaseTime(int d, int c, dReal t_capture, dReal latency, dReal jitter, JitterModel model)
+{
+    latency += sendJitter(jitter, model);
+    dReal release = t_capture + qMax(latency, (dReal)0)/1000.0;
+    if (release < lastRelease[d][c]) release = lastRelease[d][c];
+    lastRelease[d][c] = release;
+    return release;
+}
+
+// Random part of the send latency, in milliseconds
+dReal VisionSender::sendJitter(dReal jitter, JitterModel model)
+{
+    if (jitter <= 0) return 0;
+    if (model == JITTER_UNIFORM) return random.uniform()*jitter;
+    if (model == JITTER_EXPONENTIAL) return -jitter*log(1 - random.uniform());
+    double g;
+    random.gaussian(&g, 1);
+    return g*jitter;
+}
+
+void VisionSender::sendDue(dReal now, QUdpSocket* socket)
+{
+    SendLateness late = {0, 0, 0};
+    RoboCupSSLServer* servers[DELAY_LINE_DESTINATIONS];
+    servers[0] = server;
+    for (int s=0;s<nSubscribers;s++) servers[s+1] = subscribers[s].server;
+    delayLine.send(now, servers, nSubscribers + 1, &late, socket);
+    if (late.count == 0) return;
+    statsMutex.lock();
+    lateness.sum += late.sum;
+    lateness.count += late.count;
+    if (late.max > lateness.max) lateness.max = late.max;
+    statsMutex.unlock();
+}
+
+// Replaces the subscribers, stopping the thread first, the world starts it again with its next frame. The packets
+// still waiting are dropped.
+void VisionSender::setSubscribers(const VisionSubscriber* subs, int count)
+{
+    if (isRunning())
+    {
+        requestInterruption();
+        wait();
+    }
+    nSubscribers = qMin(count, VISION_MAX_SUBSCRIBERS);
+    for (int s=0;s<nSubscribers;s++) subscribers[s] = subs[s];
+    delayLine.clear();
+    for (int d=0;d<DELAY_LINE_DESTINATIONS;d++)
+        for (int c=0;c<MAX_CAMERA_COUNT;c++) lastRelease[d][c] = 0;
+}
+
+void VisionSender::setClock(dReal now)
+{
+    clockOffset = (int64_t) ((now - steadyTime())*1e6);
+}
+
+dReal VisionSender::clock() const
+{
+    return steadyTime() + clockOffset/1e6;
+}
+
+// How late the packets left after their release times, and how large the packets of the frames were, since the
+// previous report
+QString VisionSender::report()
+{
+    statsMutex.lock();
+    SendLateness late = lateness;
+    lateness.sum = lateness.max = 0;
+    lateness.count = 0;
+    PacketStats packet = packetStats;
+    memset(&packetStats, 0, sizeof(packetStats));
+    statsMutex.unlock();
+    if (late.count == 0 && packet.frames == 0) return QString("no packets");
+    QString s = late.count == 0 ? QString("nothing sent")
+        : QString("send jitter %1 ms mean, %2 ms max").arg(late.sum/late.count*1000, 0, 'f', 2).arg(late.max*1000, 0, 'f', 2);
+    if (packet.frames > 0)
+        s += QString(", %1 datagrams and %2 bytes per frame, largest %3 bytes")
+                .arg((double) packet.datagrams/packet.frames, 0, 'f', 1).arg(packet.bytes/packet.frames, 0, 'f', 0).arg(packet.largest);
+    if (packet.splitPackets > 0) s += QString(", %1 packets split").arg(packet.splitPackets);
+    if (droppedFrames > 0) s += QString(", %1 frames dropped").arg(droppedFrames);
+    if (nSubscribers > 0) s += QString(", %1 subscribers").arg(nSubscribers);
+    return s;
+}
+
+// Sends every packet at its release time, and otherwise polls the queue for new frames every millisecond
+void VisionSender::run()
+{
+    // bound right away so that its descriptor exists for the batched sends
+    QUdpSocket socket;
+    socket.bind(QHostAddress(QHostAddress::AnyIPv4), 0);
+    socket.setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
+    while (!isInterruptionRequested())
+    {
+        VisionFrame* frame;
+        while ((frame = queue.front()) != 0)
+        {
+            process(*frame);
+            queue.pop();
+        }
+        sendDue(clock(), &socket);
+        dReal wait = delayLine.nextRelease() - clock();
+        if (wait > 0) usleep((unsigned long) (qMin(wait, (dReal)0.001)*1e6));
+    }
+}